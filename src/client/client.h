@@ -17,7 +17,8 @@ extern struct client_state {
         vec3_t cam_pos;
     } game;
 
-    enum { cl_disconnected, cl_connecting, cl_connected } state;
+    // cl_offline: looking at a world loaded from disk (map command), there is no server
+    enum { cl_disconnected, cl_connecting, cl_connected, cl_offline } state;
 
     bool done;   // used in the main loop
     bool active; // whether the window is focused
@@ -195,6 +195,7 @@ void disconnect_f(void);
 void connect_f(void);
 void say_f(void);
 void respawn_f(void);
+void map_f(void);
 
 void dropitem_f(void)
 {
@@ -255,4 +256,5 @@ void cmds_register(void)
     cmd_register("respawn", respawn_f);
     cmd_register("dropitem", dropitem_f);
     cmd_register("slot", slot_f);
+    cmd_register("map", map_f);
 }
@@ -4,17 +4,49 @@
 #include "input.h"
 #include "vid/vid.h"
 #include "common.h"
+#include "cvar.h"
 #include <ctype.h>
 
-#define CONSOLE_MAX_LINES 512
+#define CONSOLE_MAX_LINES 2048 // power of two
 #define CONSOLE_MAX_LINE 256
+#define CONSOLE_TEXT_SIZE (1024 * 64)
+#define CONSOLE_MAX_TEXT_LINE 1024 // longer lines are split
 #define HISTORY_MAX_LINES 1024
 
-static size_t conbuf_len = 0;
-static char conbuf[1024 * 64] = {0}; // fixme buf?
+#define CONSOLE_SINK_SIZE (1024 * 256)
+
+/* the console text is a ring of lines: their characters go into a ring of bytes (a line never
+ * wraps around its end, each one is followed by a null terminator) and an index ring points at
+ * them. old lines are dropped as new text overwrites them. positions only ever grow and are
+ * taken modulo the ring sizes */
+static char con_text[CONSOLE_TEXT_SIZE];
+static struct con_line {
+	uint64_t start;
+	size_t length;
+} con_lines[CONSOLE_MAX_LINES];
+static uint64_t con_first_line, con_next_line; // con_next_line - 1 is the newest line
+static bool con_line_open; // the newest line did not get its newline yet
+static uint64_t con_text_end; // one past the terminator of the newest line
+
+/* everything printed is also handed to a writer thread, which writes it to stdout and to
+ * con_logfile, so that printing never waits on a terminal or a disk. if the writer can't
+ * keep up the overflow is dropped and counted */
+static struct {
+	SDL_Thread *thread;
+	SDL_mutex *lock;
+	SDL_cond *wake;
+	bool quit;
+
+	char buf[CONSOLE_SINK_SIZE];
+	size_t head, tail; // ring positions, empty when equal
+	size_t dropped;
+
+	char log_name[256];
+	bool reopen_log;
+} sink;
+
 static char input_line[CONSOLE_MAX_LINE + 1] = {0};
 static int input_pos = 0;
-static int line_count = 0;
 static char history[HISTORY_MAX_LINES][sizeof(input_line)] = {0};
 static int history_idx = 0;
 static int history_len = 0;
@@ -42,12 +74,131 @@ void con_hide(void)
 	}
 }
 
+static int sink_writer(void *data attr(unused))
+{
+	static char chunk[CONSOLE_SINK_SIZE];
+	FILE *log = NULL;
+
+	SDL_LockMutex(sink.lock);
+	while(true) {
+		size_t n = 0, dropped;
+		bool reopen;
+		char log_name[sizeof(sink.log_name)];
+
+		while(!sink.quit && sink.head == sink.tail && !sink.reopen_log)
+			SDL_CondWait(sink.wake, sink.lock);
+
+		/* take everything there is and write it without holding the lock */
+		while(sink.tail != sink.head) {
+			size_t len = sink.head > sink.tail ? sink.head - sink.tail : CONSOLE_SINK_SIZE - sink.tail;
+			memcpy(chunk + n, sink.buf + sink.tail, len);
+			n += len;
+			sink.tail = (sink.tail + len) % CONSOLE_SINK_SIZE;
+		}
+		dropped = sink.dropped;
+		sink.dropped = 0;
+		reopen = sink.reopen_log;
+		sink.reopen_log = false;
+		strlcpy(log_name, sink.log_name, sizeof(log_name));
+
+		if(n == 0 && !reopen && sink.quit)
+			break;
+		SDL_UnlockMutex(sink.lock);
+
+		if(reopen) {
+			if(log)
+				fclose(log);
+			log = log_name[0] ? fopen(log_name, "a") : NULL;
+		}
+
+		fwrite(chunk, 1, n, stdout);
+		if(log)
+			fwrite(chunk, 1, n, log);
+		if(dropped) {
+			printf("(%zu bytes of console output dropped)\n", dropped);
+			if(log)
+				fprintf(log, "(%zu bytes of console output dropped)\n", dropped);
+		}
+		fflush(stdout);
+		if(log)
+			fflush(log);
+
+		SDL_LockMutex(sink.lock);
+	}
+	SDL_UnlockMutex(sink.lock);
+
+	if(log)
+		fclose(log);
+	return 0;
+}
+
+static void sink_write(const char *text, size_t len)
+{
+	size_t space;
+
+	if(!sink.thread) {
+		// not started yet or already stopped
+		fwrite(text, 1, len, stdout);
+		return;
+	}
+
+	SDL_LockMutex(sink.lock);
+	space = CONSOLE_SINK_SIZE - 1 - (sink.head + CONSOLE_SINK_SIZE - sink.tail) % CONSOLE_SINK_SIZE;
+	if(len > space) {
+		sink.dropped += len - space;
+		len = space;
+	}
+	for(size_t i = 0; i < len; ) {
+		size_t n = min(len - i, CONSOLE_SINK_SIZE - sink.head);
+		memcpy(sink.buf + sink.head, text + i, n);
+		sink.head = (sink.head + n) % CONSOLE_SINK_SIZE;
+		i += n;
+	}
+	SDL_CondSignal(sink.wake);
+	SDL_UnlockMutex(sink.lock);
+}
+
+void onchange_con_logfile(void)
+{
+	if(!sink.thread)
+		return;
+
+	SDL_LockMutex(sink.lock);
+	strlcpy(sink.log_name, con_logfile.string, sizeof(sink.log_name));
+	sink.reopen_log = true;
+	SDL_CondSignal(sink.wake);
+	SDL_UnlockMutex(sink.lock);
+}
+
 errcode con_init(void)
 {
+	sink.lock = SDL_CreateMutex();
+	sink.wake = SDL_CreateCond();
+	if(sink.lock && sink.wake)
+		sink.thread = SDL_CreateThread(sink_writer, "console", NULL);
+	if(!sink.thread)
+		con_printf("console: no writer thread (%s), printing directly\n", SDL_GetError());
+
 	cmd_register("toggleconsole", toggleconsole_f);
 	return cmd_init();
 }
 
+void con_shutdown(void)
+{
+	if(!sink.thread)
+		return;
+
+	SDL_LockMutex(sink.lock);
+	sink.quit = true;
+	SDL_CondSignal(sink.wake);
+	SDL_UnlockMutex(sink.lock);
+
+	SDL_WaitThread(sink.thread, NULL);
+	sink.thread = NULL;
+	SDL_DestroyCond(sink.wake);
+	SDL_DestroyMutex(sink.lock);
+}
+
 static void con_put_char(ubyte c)
 {
 	if(input_pos < CONSOLE_MAX_LINE) {
@@ -82,13 +233,28 @@ static void con_submit(void)
 	history_idx = 0;
 }
 
+static struct con_line *con_line(uint64_t i);
+
+/* con_scroll counts whole lines. scrolled all the way up, the oldest lines that fit on the
+ * screen together are shown */
 static int calc_max_scroll(void)
 {
-	int visible_lines = (ui_h / 2 - LINE_HEIGHT_PX) / LINE_HEIGHT_PX;
-	int max = line_count - visible_lines;
-	if(max < 0)
-		max = 0;
-	return max;
+	int visible_rows = (ui_h / 2 - LINE_HEIGHT_PX) / LINE_HEIGHT_PX;
+	uint64_t i = con_first_line;
+
+	for(; i < con_next_line; i++) {
+		struct con_line *line = con_line(i);
+		int rows = ui_run_rows(ui_get_run(&con_text[line->start % CONSOLE_TEXT_SIZE], ui_w - 2));
+		if(rows > visible_rows)
+			break;
+		visible_rows -= rows;
+	}
+
+	// a line taller than the screen still gets shown from its end
+	if(i == con_first_line && i < con_next_line)
+		i++;
+
+	return (int) (con_next_line - i);
 }
 
 bool con_handle_key(int key, int keymod)
@@ -170,11 +336,11 @@ bool con_handle_key(int key, int keymod)
 		} break;
 
 		case KEY_MOUSEWHEELDOWN: {
-			con_scroll--;
+			con_scroll = max(con_scroll - 1, 0);
 		} break;
 
 		case KEY_MOUSEWHEELUP: {
-			con_scroll++;
+			con_scroll = min(con_scroll + 1, calc_max_scroll());
 		} break;
 
 		// TODO: THIS IS JANK!
@@ -231,29 +397,88 @@ bool con_handle_key(int key, int keymod)
 	return true;
 }
 
+static struct con_line *con_line(uint64_t i)
+{
+	return &con_lines[i & (CONSOLE_MAX_LINES - 1)];
+}
+
+// makes room for the newest line to end right before 'end', dropping the lines in the way
+static void con_reserve_text(uint64_t end)
+{
+	while(con_first_line < con_next_line - 1 && con_line(con_first_line)->start + CONSOLE_TEXT_SIZE < end)
+		con_first_line++;
+}
+
+static void con_new_line(void)
+{
+	struct con_line *line;
+
+	if(con_next_line - con_first_line == CONSOLE_MAX_LINES)
+		con_first_line++;
+
+	line = con_line(con_next_line++);
+	line->start = con_text_end;
+	line->length = 0;
+	if(line->start % CONSOLE_TEXT_SIZE == CONSOLE_TEXT_SIZE - 1)
+		line->start++;
+
+	con_reserve_text(line->start + 1);
+	con_text[line->start % CONSOLE_TEXT_SIZE] = '\0';
+	con_text_end = line->start + 1;
+	con_line_open = true;
+}
+
+static void con_put_text(const char *text, size_t len)
+{
+	for(size_t i = 0; i < len; i++) {
+		struct con_line *line;
+		size_t pos;
+
+		if(!con_line_open || con_line(con_next_line - 1)->length == CONSOLE_MAX_TEXT_LINE)
+			con_new_line();
+		line = con_line(con_next_line - 1);
+
+		if(text[i] == '\n') {
+			con_line_open = false;
+			continue;
+		}
+
+		/* a line must not wrap around the end of the ring, move it to the start instead */
+		pos = line->start % CONSOLE_TEXT_SIZE;
+		if(pos + line->length + 2 > CONSOLE_TEXT_SIZE) {
+			uint64_t start = line->start + CONSOLE_TEXT_SIZE - pos;
+			con_reserve_text(start + line->length + 2);
+			memmove(con_text, con_text + pos, line->length);
+			line->start = start;
+			pos = 0;
+		}
+
+		con_reserve_text(line->start + line->length + 2);
+		con_text[pos + line->length++] = text[i];
+		con_text[pos + line->length] = '\0';
+		con_text_end = line->start + line->length + 1;
+	}
+}
+
 void con_printf(char *fmt, ...)
 {
 	va_list va;
-	size_t n;
+	char buf[4096];
+	int n;
 
 	if(!fmt)
 		return;
 
 	va_start(va, fmt);
-	n = (size_t) vsnprintf(conbuf + conbuf_len, sizeof(conbuf) - conbuf_len, fmt, va);
-	printf("%s", conbuf + conbuf_len);
-	conbuf_len += n + 1; // todo do not include the null terminator
-
+	n = vsnprintf(buf, sizeof(buf), fmt, va);
 	va_end(va);
 
-	if(conbuf_len >= sizeof(conbuf)) {
-		// free old stuff
-		// todo reprint again
-		size_t nb = sizeof(conbuf) / 2;
-		memmove(conbuf, conbuf + nb, nb);
-		conbuf_len = nb;
-		conbuf_len += snprintf(conbuf, sizeof(conbuf), "console buffer truncated\n");
-	}
+	if(n < 0)
+		return;
+	n = min(n, (int) sizeof(buf) - 1);
+
+	con_put_text(buf, n);
+	sink_write(buf, n);
 }
 
 static void draw_input_line(int y)
@@ -285,93 +510,24 @@ static void draw_input_line(int y)
 	}
 }
 
-static char *get_last_word_that_fits_in_width(char *text, int maxwidth)
-{
-	int w = 0;
-	char *lastword = text;
-	while(*text && w < maxwidth) {
-		w += ui_charwidth(*text);
-		if(isspace(*text)) {
-			lastword = text;
-		}
-		text++;
-	}
-	return w > 0 ? lastword + 1 : NULL;
-}
-
-static void drawwrap(int x, int *y, char *p, int *scroll)
-{
-	char *end;
-	char old;
-
-	if(*y < -LINE_HEIGHT_PX || *y >= ui_h)
-		return;
-
-	// todo: calculate proper y and go down instead of up? thus removing recursion
-	end = get_last_word_that_fits_in_width(p, ui_w);
-
-	if(!end)
-		// drawtext p?
-		return;
-
-	if(ui_strwidth(end) > ui_w) {
-		drawwrap(x, y, end, scroll);
-	} else {
-		if(*scroll <= 0) {
-			ui_drawtext(x, *y, end);
-			*y -= LINE_HEIGHT_PX;
-		}
-		(*scroll)--;
-	}
-
-	if(*scroll <= 0) {
-		old = *end;
-		*end = 0;
-		ui_drawtext(x, *y, p);
-		*end = old;
-		*y -= LINE_HEIGHT_PX;
-	} else {
-		(*scroll)--;
-	}
-}
-
 void ui_draw_console(void)
 {
 	int y = ui_h / 2;
 	int scroll = con_scroll;
-	int num_lines_that_fit = y / LINE_HEIGHT_PX;
-	char *p;
 
 	if(!con_opened)
 		return;
 
 	draw_input_line(y);
 
-	if(conbuf_len <= 0)
-		return;
+	/* every line is a cached glyph run, laid out and wrapped once. scrolling skips whole lines,
+	 * the same unit calc_max_scroll counts in */
+	for(uint64_t i = con_next_line - min((uint64_t) max(scroll, 0), con_next_line - con_first_line);
+	    i > con_first_line && y > 0; i--) {
+		struct con_line *line = con_line(i - 1);
+		const ui_run *run = ui_get_run(&con_text[line->start % CONSOLE_TEXT_SIZE], ui_w - 2);
 
-	y -= LINE_HEIGHT_PX;
-
-	p = conbuf + conbuf_len - 2;
-	for(int i = 0; i < num_lines_that_fit + con_scroll; i++) {
-		while(p > conbuf && *p)
-			p--;
-		if(p != conbuf)
-			p++;
-		if(ui_strwidth(p) >= ui_w - 8) {
-			drawwrap(1, &y, p, &scroll);
-		} else if(scroll <= 0) {
-			ui_printf(1, y, p);
-			y -= LINE_HEIGHT_PX;
-		}
-		scroll--;
-		if(p <= conbuf) {
-			break;
-		}
-		if(y <= -LINE_HEIGHT_PX) {
-			// further lines can't be seen
-			break;
-		}
-		p -= 2;
+		y -= ui_run_rows(run) * LINE_HEIGHT_PX;
+		ui_drawrun(1, y, run, 0, ui_run_rows(run));
 	}
 }
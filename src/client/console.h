@@ -43,6 +43,8 @@ extern bool con_opened;
 extern int con_scroll;
 
 errcode con_init(void);
+// flushes the console output still waiting to be written, call last
+void con_shutdown(void);
 bool con_handle_key(int key, int keymod);
 
 void con_show(void);
@@ -70,14 +70,23 @@ void recalculate_projection_matrix(void); // in world_renderer.c
 void onchange_block_render_modes(void);   // in block.c
 void onchange_ui_scale(void);             // in ui.c
 void onchange_cl_freecamera(void);        // in input.c
+void onchange_world_max_memory_mb(void);  // in world.c
+void onchange_con_logfile(void);          // in console.c
 
 cvar r_zfar = {"r_zfar", "256", recalculate_projection_matrix};
 cvar r_znear = {"r_znear", "0.1", recalculate_projection_matrix};
 cvar r_max_remeshes = {"r_max_remeshes", "2"};
 cvar r_fancyleaves = {"r_fancyleaves", "1", onchange_block_render_modes};
-cvar r_fancygrass = {"r_fancygrass", "1", onchange_block_render_modes};
+cvar r_fancygrass = {"r_fancygrass", "1"};
 cvar r_smartleaves = {"r_smartleaves", "0", onchange_block_render_modes};
 cvar r_redstone_dot = {"r_redstone_dot", "0", onchange_block_render_modes};
+cvar r_cave_culling = {"r_cave_culling", "1"};
+cvar r_occlusion_culling = {"r_occlusion_culling", "1"};
+cvar r_lod = {"r_lod", "1"};
+cvar r_lod_distance = {"r_lod_distance", "12"};
+cvar r_mesh_cache = {"r_mesh_cache", "0"};
+cvar r_mesh_cache_mb = {"r_mesh_cache_mb", "256"};
+cvar r_detail_distance = {"r_detail_distance", "64"};
 cvar gl_polygon_mode = {"gl_polygon_mode", "GL_FILL"};
 
 cvar vid_width = {"vid_width", "854"};
@@ -91,8 +100,11 @@ cvar fov = {"fov", "90", recalculate_projection_matrix};
 cvar cl_smoothstep = {"cl_smoothstep", "1"};
 cvar cl_2b2tmode = {"cl_2b2tmode", "0"};
 cvar cl_freecamera = {"cl_freecamera", "0", onchange_cl_freecamera};
+cvar cl_chunk_cache = {"cl_chunk_cache", "1"};
+cvar world_max_memory_mb = {"world_max_memory_mb", "256", onchange_world_max_memory_mb};
 
 cvar ui_scale = {"ui_scale", "2", onchange_ui_scale};
+cvar con_logfile = {"con_logfile", "", onchange_con_logfile};
 
 errcode cvar_init(void)
 {
@@ -113,7 +125,17 @@ errcode cvar_init(void)
 	cvar_register(&sensitivity);
 	cvar_register(&cl_smoothstep);
 	cvar_register(&r_redstone_dot);
+	cvar_register(&r_cave_culling);
+	cvar_register(&r_occlusion_culling);
+	cvar_register(&r_lod);
+	cvar_register(&r_lod_distance);
+	cvar_register(&r_mesh_cache);
+	cvar_register(&r_mesh_cache_mb);
+	cvar_register(&r_detail_distance);
 	cvar_register(&cl_freecamera);
+	cvar_register(&cl_chunk_cache);
+	cvar_register(&world_max_memory_mb);
+	cvar_register(&con_logfile);
 
     return ERR_OK;
 }
@@ -35,6 +35,13 @@ extern cvar r_fancyleaves;
 extern cvar r_fancygrass;
 extern cvar r_smartleaves;
 extern cvar r_redstone_dot;
+extern cvar r_cave_culling;
+extern cvar r_occlusion_culling;
+extern cvar r_lod;
+extern cvar r_lod_distance;
+extern cvar r_mesh_cache;
+extern cvar r_mesh_cache_mb;
+extern cvar r_detail_distance;
 
 extern cvar gl_polygon_mode;
 
@@ -44,7 +51,10 @@ extern cvar vid_height;
 extern cvar cl_2b2tmode;
 extern cvar cl_smoothstep;
 extern cvar cl_freecamera;
+extern cvar cl_chunk_cache;
+extern cvar world_max_memory_mb;
 
 extern cvar ui_scale;
+extern cvar con_logfile;
 
 #endif
@@ -8,6 +8,14 @@
 #include <stdio.h>
 #include <uchar.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#define sys_mkdir(path) _mkdir(path)
+#else
+#define sys_mkdir(path) mkdir(path, 0755)
+#endif
 
 #define attr(a) __attribute__((__##a##__))
 
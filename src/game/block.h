@@ -1,6 +1,7 @@
 #ifndef B173C_BLOCK_H
 #define B173C_BLOCK_H
 
+#include <stdint.h>
 #include "common.h"
 #include "block_ids.h"
 #include "mathlib.h"
@@ -45,6 +46,14 @@ typedef enum {
     RENDER_TYPE_COUNT
 } block_render_type;
 
+/* mesh buckets, drawn in this order with different gl state */
+typedef enum {
+    RENDER_PASS_OPAQUE,      // no blending, no alpha test
+    RENDER_PASS_CUTOUT,      // alpha test (leaves, plants, torches...)
+    RENDER_PASS_TRANSLUCENT, // blending, no depth writes (water, ice)
+    RENDER_PASS_COUNT
+} block_render_pass;
+
 typedef ubyte block_id;
 
 typedef struct {
@@ -58,43 +67,87 @@ typedef struct {
     char *name;
     float hardness;
     ubyte texture_indices[6];
-    bool opaque;
-    block_render_type render_type;
 } block_properties;
 
-// :P fixme !
-#define block_is_solid(b)                                            \
-    ((b).id != 0 && (b).id != 9 && (b).id != 10 && (b).id != 11 &&   \
-     (b).id != 27 && (b).id != 28 && (b).id != 31 && (b).id != 32 && \
-     (b).id != 37 && (b).id != 38 && (b).id != 39 && (b).id != 40 && \
-     (b).id != 50 && (b).id != 51 && (b).id != 55 && (b).id != 59 && \
-     (b).id != 65 && (b).id != 66 && (b).id != 69 && (b).id != 75 && \
-     (b).id != 76 && (b).id != 77 && (b).id != 78 && (b).id != 83 && \
-     (b).id != 90 && (b).id != 93 && (b).id != 94)
+typedef enum {
+    BLOCK_FLAG_OPAQUE,      // hides the faces of its neighbours
+    BLOCK_FLAG_SOLID,
+    BLOCK_FLAG_COLLIDABLE,  // for some metadata at least, see block_is_collidable
+    BLOCK_FLAG_SELECTABLE,
+    BLOCK_FLAG_FLUID,
+    BLOCK_FLAG_TRANSLUCENT, // water and ice
+    BLOCK_FLAG_FLAMMABLE,
+    BLOCK_FLAG_DYNTEX,      // texture not covered by block_textures
+    BLOCK_FLAG_COUNT
+} block_flag;
+
+/* per id tables, generated from blocks.def by prepare_block_tables.py. the flags are bitsets of
+ * 256 bits each. r_fancyleaves changes the leaves entries at runtime */
+extern block_properties block_defs[256];
+extern uint64_t block_flags[BLOCK_FLAG_COUNT][4];
+extern ubyte block_render_types[256];
+extern ubyte block_render_passes[256];
+
+#define block_has_flag(id, flag) ((block_flags[(flag)][(ubyte) (id) >> 6] >> ((id) & 63)) & 1)
+
+#define block_is_solid(b) block_has_flag((b).id, BLOCK_FLAG_SOLID)
 
 #define block_is_empty(b) ((b).id == BLOCK_AIR)
 
-#define block_is_liquid(b)                                          \
-    ((b).id == BLOCK_WATER_STILL || (b).id == BLOCK_WATER_MOVING || \
-     (b).id == BLOCK_LAVA_STILL  || (b).id == BLOCK_LAVA_MOVING)
+#define block_is_liquid(b) block_has_flag((b).id, BLOCK_FLAG_FLUID)
+
+#define block_is_transparent(b) (!block_has_flag((b).id, BLOCK_FLAG_OPAQUE))
+
+#define block_is_semi_transparent(b) block_has_flag((b).id, BLOCK_FLAG_TRANSLUCENT)
+
+// thin snow layers are the only blocks whose collision depends on the metadata
+#define block_is_collidable(b) \
+    (block_has_flag((b).id, BLOCK_FLAG_COLLIDABLE) && ((b).id != BLOCK_SNOW_LAYER || ((b).metadata & 7) >= 3))
+
+#define block_is_selectable(b) block_has_flag((b).id, BLOCK_FLAG_SELECTABLE)
+
+#define block_is_flammable(id) block_has_flag((id), BLOCK_FLAG_FLAMMABLE)
+
+#define block_get_render_type(id) ((block_render_type) block_render_types[(ubyte) (id)])
+
+#define block_get_render_pass(b) ((block_render_pass) block_render_passes[(b).id])
+
+/* collision and selection boxes per (id, metadata), relative to the block and built once by
+ * block_shapes_init from block_get_bbox. an empty shape means nothing to collide with or select.
+ * dynamic shapes depend on the neighbours, call block_get_bbox with the real position for those */
+#define BLOCK_MAX_BOXES 2
+
+typedef struct {
+    ubyte count;
+    bool dynamic;
+    bbox_t boxes[BLOCK_MAX_BOXES];
+} block_shape;
+
+extern block_shape block_shape_pool[];
+extern uint16_t block_shape_index[2][256 * 16];
+
+#define block_get_shape(b, selectmode) \
+    (&block_shape_pool[block_shape_index[(selectmode) ? 1 : 0][(b).id << 4 | (b).metadata]])
 
+void block_shapes_init(void);
 
-#define block_is_transparent(b) (block_get_properties((b).id).opaque == 0)
+const block_properties *block_get_properties(block_id id);
+/* texture per (id, metadata, face), built by block_textures_init from block_compute_texture_index.
+ * negative indices are horizontally flipped. dyntex blocks always take the slow path */
+extern int16_t block_textures[256 * 16][6];
 
-#define block_is_semi_transparent(b)                                \
-    ((b).id == BLOCK_WATER_STILL || (b).id == BLOCK_WATER_MOVING || \
-     (b).id == BLOCK_ICE)
+#define block_get_texture_index(id, face, metadata, x, y, z)                           \
+    (block_has_flag((id), BLOCK_FLAG_DYNTEX)                                           \
+         ? block_compute_texture_index((id), (face), (metadata), (x), (y), (z))        \
+         : block_textures[(ubyte) (id) << 4 | ((metadata) & 15)][(face)])
 
-block_properties block_get_properties(block_id id);
-int block_get_texture_index(block_id id, block_face face, ubyte metadata, int x, int y, int z);
+void block_textures_init(void);
+int block_compute_texture_index(block_id id, block_face face, ubyte metadata, int x, int y, int z);
 bool block_should_render_face(int x, int y, int z, block_data self, block_face face);
 float block_fluid_get_percent_air(ubyte metadata);
 float block_fluid_get_height(int x, int y, int z, block_id self_id);
 vec3_t block_fluid_get_flow_direction(int x, int y, int z);
 bbox_t block_get_bbox(block_data self, int x, int y, int z, bool selectmode);
-bool block_is_collidable(block_data block);
-bool block_is_selectable(block_data block);
-bool block_is_flammable(block_id id);
 const char *block_face_to_str(block_face f);
 
 #define METADATA_DOOR_ROT (3)
@@ -3,9 +3,9 @@
 #include "client/cvar.h"
 #include "world.h"
 
-int block_get_texture_index(block_id id, block_face face, ubyte metadata, int x, int y, int z)
+int block_compute_texture_index(block_id id, block_face face, ubyte metadata, int x, int y, int z)
 {
-    block_properties props = block_get_properties(id);
+    const block_properties *props = block_get_properties(id);
     int off = 0;
 
     switch(id) {
@@ -18,10 +18,10 @@ int block_get_texture_index(block_id id, block_face face, ubyte metadata, int x,
         break;
     case BLOCK_WOOD_LOG:
         if(IS_SIDE_FACE(face))
-            return props.texture_indices[face] + (metadata == 0 ? 0 : (16 * 6 + (metadata - 1)));
+            return props->texture_indices[face] + (metadata == 0 ? 0 : (16 * 6 + (metadata - 1)));
         break;
     case BLOCK_LEAVES:
-        return props.texture_indices[face] +
+        return props->texture_indices[face] +
                (!r_fancyleaves.integer) + // +1 is for opaque leaves
                (metadata == 1 ? (16 * 5) : 0); // oak/birch leaves use the same texture - move only if spruce
     case BLOCK_TALLGRASS:
@@ -29,10 +29,10 @@ int block_get_texture_index(block_id id, block_face face, ubyte metadata, int x,
             off = 16;
         else if(metadata == 2)
             off = 16 + 1;
-        return props.texture_indices[face] + off;
+        return props->texture_indices[face] + off;
     case BLOCK_CLOTH:
         if(metadata == 0)
-            return props.texture_indices[face];
+            return props->texture_indices[face];
         metadata = ~(metadata & 15);
         return (7 * 16 + 1) + ((metadata & 8) >> 3) + 16 * (metadata & 7); // :P
     case BLOCK_SLAB_SINGLE:
@@ -62,18 +62,18 @@ int block_get_texture_index(block_id id, block_face face, ubyte metadata, int x,
         break;
     case BLOCK_WORKBENCH:
         if(IS_SIDE_FACE(face) && (face == BLOCK_FACE_Z_NEG || face == BLOCK_FACE_X_NEG))
-            return props.texture_indices[face] + 1;
+            return props->texture_indices[face] + 1;
         break;
     case BLOCK_CROP_WHEAT:
-        return props.texture_indices[face] + metadata;
+        return props->texture_indices[face] + metadata;
     case BLOCK_FARMLAND:
         if(face == BLOCK_FACE_Y_POS)
-            return props.texture_indices[BLOCK_FACE_Y_POS] - (int) (metadata != 0);
+            return props->texture_indices[BLOCK_FACE_Y_POS] - (int) (metadata != 0);
         break;
         /* directional blocks */
     case BLOCK_BED:
         if(face == BLOCK_FACE_Y_NEG)
-            return block_get_properties(BLOCK_WOOD_PLANKS).texture_indices[face];
+            return block_get_properties(BLOCK_WOOD_PLANKS)->texture_indices[face];
         {
             // refer to notes/metadata_bed.png
             const int offsets[2][4][6] = {
@@ -92,7 +92,7 @@ int block_get_texture_index(block_id id, block_face face, ubyte metadata, int x,
             };
             int rot = metadata & METADATA_BED_ROT;
             bool is_pillow = (metadata & METADATA_BED_PILLOW) != 0;
-            int idx = props.texture_indices[face];
+            int idx = props->texture_indices[face];
             int offset = offsets[is_pillow][rot][face];
             if(offset < 0) {
                 return -idx + offset;
@@ -110,7 +110,7 @@ int block_get_texture_index(block_id id, block_face face, ubyte metadata, int x,
     case BLOCK_FURNACE_IDLE:
         off = (id == BLOCK_DISPENSER ? 1 : (id == BLOCK_FURNACE_IDLE ? -1 : 16));
         if(IS_SIDE_FACE(face) && metadata == face)
-            return props.texture_indices[face] + off;
+            return props->texture_indices[face] + off;
         break;
     case BLOCK_PUMPKIN_LANTERN:
         off = 1;
@@ -121,7 +121,7 @@ int block_get_texture_index(block_id id, block_face face, ubyte metadata, int x,
             // fixme: add faceless pumpkins for metadata >= 5
             const block_face d[4] = {BLOCK_FACE_Z_POS, BLOCK_FACE_X_NEG, BLOCK_FACE_Z_NEG, BLOCK_FACE_X_POS};
             if(d[bound(0, metadata, 3)] == face) {
-                return props.texture_indices[face] + 1 + off;
+                return props->texture_indices[face] + 1 + off;
             }
         }
         break;
@@ -149,7 +149,7 @@ int block_get_texture_index(block_id id, block_face face, ubyte metadata, int x,
                 // ok whatever TODO: document this more
                 uint32_t flags = ((rot >> 1) + (IS_POS_FACE(face) ^ rot)) + is_open;
 
-                int idx = props.texture_indices[face];
+                int idx = props->texture_indices[face];
                 if(is_top_half)
                     idx -= 16;
 
@@ -163,18 +163,28 @@ int block_get_texture_index(block_id id, block_face face, ubyte metadata, int x,
         }
     case BLOCK_RAIL:
         if(metadata >= 6 && metadata <= 9)
-            return props.texture_indices[face] - 16; // corner texture
+            return props->texture_indices[face] - 16; // corner texture
         /* fall through */
     case BLOCK_RAIL_POWERED:
     case BLOCK_RAIL_DETECTOR:
-        return props.texture_indices[face];
+        return props->texture_indices[face];
     case BLOCK_GRASS_OVERLAY:
         return 6 + 16 * 2;
     default:
         break;
     }
 
-    return props.texture_indices[face];
+    return props->texture_indices[face];
+}
+
+int16_t block_textures[256 * 16][6];
+
+void block_textures_init(void)
+{
+    for(int i = 0; i < 256 * 16; i++) {
+        for(int face = 0; face < 6; face++)
+            block_textures[i][face] = block_compute_texture_index(i >> 4, face, i & 15, 0, 0, 0);
+    }
 }
 
 bbox_t block_get_bbox(block_data self, int x, int y, int z, bool selectmode)
@@ -476,20 +486,78 @@ bbox_t block_get_bbox(block_data self, int x, int y, int z, bool selectmode)
     return bbox_offset((bbox_t) {vec3(0, 0, 0), vec3(1, 1, 1)}, vec3(x, y, z));
 }
 
-bool block_is_flammable(block_id id)
+#define BLOCK_MAX_SHAPES 1024
+
+block_shape block_shape_pool[BLOCK_MAX_SHAPES];
+uint16_t block_shape_index[2][256 * 16];
+static size_t n_shapes;
+
+static uint16_t add_shape(const block_shape *shape)
 {
-    switch(id) {
-    case BLOCK_WOOD_PLANKS:
-    case BLOCK_FENCE:
-    case BLOCK_STAIRS_WOOD:
-    case BLOCK_WOOD_LOG:
-    case BLOCK_LEAVES:
-    case BLOCK_BOOKSHELF:
-    case BLOCK_TNT:
-    case BLOCK_TALLGRASS:
-    case BLOCK_CLOTH:
-        return true;
-    default:
-        return false;
+    for(size_t i = 0; i < n_shapes; i++) {
+        if(memcmp(&block_shape_pool[i], shape, sizeof(*shape)) == 0)
+            return i;
+    }
+
+    if(n_shapes == BLOCK_MAX_SHAPES) {
+        con_printf("block_shapes_init: out of shapes\n");
+        return 0;
+    }
+
+    block_shape_pool[n_shapes] = *shape;
+    return n_shapes++;
+}
+
+static void build_shape(block_shape *shape, block_data self, bool selectmode)
+{
+    const bbox_t full = {vec3(0, 0, 0), vec3(1, 1, 1)};
+
+    memset(shape, 0, sizeof(*shape));
+
+    if(selectmode ? !block_is_selectable(self) : !block_is_collidable(self))
+        return;
+
+    /* stairs collide as a slab and a half-block step, they are selected as a whole */
+    if(!selectmode && (self.id == BLOCK_STAIRS_STONE || self.id == BLOCK_STAIRS_WOOD)) {
+        const bbox_t stairs[4][2] = {
+            {{vec3(0, 0, 0), vec3(0.5f, 0.5f, 1)}, {vec3(0.5f, 0, 0), vec3(1, 1, 1)}},
+            {{vec3(0, 0, 0), vec3(0.5f, 1, 1)},    {vec3(0.5f, 0, 0), vec3(1, 0.5f, 1)}},
+            {{vec3(0, 0, 0), vec3(1, 0.5f, 0.5f)}, {vec3(0, 0, 0.5f), vec3(1, 1, 1)}},
+            {{vec3(0, 0, 0), vec3(1, 1, 0.5f)},    {vec3(0, 0, 0.5f), vec3(1, 0.5f, 1)}},
+        };
+
+        if(self.metadata < 4) {
+            shape->count = 2;
+            shape->boxes[0] = stairs[self.metadata][0];
+            shape->boxes[1] = stairs[self.metadata][1];
+        }
+        return;
+    }
+
+    /* portals are thin along whichever axis has no portal next to them */
+    if(selectmode && self.id == BLOCK_PORTAL) {
+        shape->count = 1;
+        shape->dynamic = true;
+        shape->boxes[0] = full;
+        return;
+    }
+
+    shape->boxes[0] = block_get_bbox(self, 0, 0, 0, selectmode);
+    if(bbox_null(shape->boxes[0]))
+        shape->boxes[0] = (bbox_t) {0};
+    else
+        shape->count = 1;
+}
+
+void block_shapes_init(void)
+{
+    block_shape shape;
+
+    n_shapes = 0;
+    for(int mode = 0; mode < 2; mode++) {
+        for(int i = 0; i < 256 * 16; i++) {
+            build_shape(&shape, (block_data) {.id = i >> 4, .metadata = i & 15}, mode);
+            block_shape_index[mode][i] = add_shape(&shape);
+        }
     }
 }
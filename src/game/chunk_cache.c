@@ -0,0 +1,154 @@
+#include <zlib.h>
+#include <ctype.h>
+#include "chunk_cache.h"
+#include "region.h"
+#include "client/cvar.h"
+
+#define MAX_OPEN_REGIONS 16
+
+/* our own compression id: a zlib compressed array of block_data. bump it when block_data changes */
+#define CHUNK_CACHE_COMPRESSION 0x42
+
+#define COLUMN_BYTES (WORLD_CHUNK_SIZE * WORLD_CHUNK_SIZE * WORLD_CHUNK_HEIGHT * sizeof(block_data))
+
+static struct {
+    bool open;
+    char dir[256];
+
+    /* least recently used region gets closed when another one is needed */
+    struct open_region {
+        bool used;
+        int x, z;
+        uint64_t last_use;
+        region_file file;
+    } regions[MAX_OPEN_REGIONS];
+    uint64_t use_counter;
+} cache;
+
+void chunk_cache_open(const char *host, int port)
+{
+    char name[128];
+    size_t i;
+
+    chunk_cache_close();
+
+    if(!cl_chunk_cache.integer)
+        return;
+
+    /* the address becomes a directory name, keep it to characters every file system takes */
+    snprintf(name, sizeof(name), "%s_%d", host, port);
+    for(i = 0; name[i] != '\0'; i++) {
+        if(!isalnum((ubyte) name[i]) && name[i] != '.' && name[i] != '-')
+            name[i] = '_';
+    }
+
+    snprintf(cache.dir, sizeof(cache.dir), CHUNK_CACHE_DIR "/%s", name);
+    sys_mkdir(CHUNK_CACHE_DIR);
+    sys_mkdir(cache.dir);
+    cache.open = true;
+}
+
+void chunk_cache_close(void)
+{
+    for(int i = 0; i < MAX_OPEN_REGIONS; i++) {
+        if(cache.regions[i].used)
+            region_close(&cache.regions[i].file);
+    }
+
+    memset(&cache, 0, sizeof(cache));
+}
+
+static region_file *get_region(int chunk_x, int chunk_z, bool writable)
+{
+    int rx = chunk_x >> 5, rz = chunk_z >> 5;
+    struct open_region *slot = &cache.regions[0];
+    char path[300];
+
+    for(int i = 0; i < MAX_OPEN_REGIONS; i++) {
+        struct open_region *r = &cache.regions[i];
+
+        if(r->used && r->x == rx && r->z == rz) {
+            r->last_use = ++cache.use_counter;
+            return &r->file;
+        }
+
+        if(!r->used || (slot->used && r->last_use < slot->last_use))
+            slot = r;
+    }
+
+    /* region files are always opened writable, a read-only open of a missing one is a plain miss */
+    snprintf(path, sizeof(path), "%s/r.%d.%d.mcr", cache.dir, rx, rz);
+    if(!writable) {
+        FILE *f = fopen(path, "rb");
+        if(f == NULL)
+            return NULL;
+        fclose(f);
+    }
+
+    if(slot->used)
+        region_close(&slot->file);
+
+    slot->used = region_open(&slot->file, path, true);
+    if(!slot->used) {
+        con_printf("chunk cache: failed to open '%s'\n", path);
+        return NULL;
+    }
+
+    slot->x = rx;
+    slot->z = rz;
+    slot->last_use = ++cache.use_counter;
+    return &slot->file;
+}
+
+bool chunk_cache_load(world_chunk *chunk)
+{
+    region_file *region;
+    const ubyte *data;
+    size_t size;
+    uLongf length = COLUMN_BYTES;
+    int compression;
+
+    if(!cache.open)
+        return false;
+
+    region = get_region(chunk->x, chunk->z, false);
+    if(region == NULL)
+        return false;
+
+    data = region_get_column(region, chunk->x, chunk->z, &size, &compression);
+    if(data == NULL || compression != CHUNK_CACHE_COMPRESSION)
+        return false;
+
+    if(uncompress((Bytef *) chunk->data, &length, data, size) != Z_OK || length != COLUMN_BYTES) {
+        memset(chunk->data, 0, COLUMN_BYTES);
+        return false;
+    }
+
+    chunk->cache_dirty = false;
+    world_mark_region_for_remesh((chunk->x << 4) - 1, 0, (chunk->z << 4) - 1,
+                                 (chunk->x << 4) + WORLD_CHUNK_SIZE, WORLD_CHUNK_HEIGHT - 1,
+                                 (chunk->z << 4) + WORLD_CHUNK_SIZE);
+    return true;
+}
+
+void chunk_cache_store(world_chunk *chunk)
+{
+    static ubyte compressed[COLUMN_BYTES + COLUMN_BYTES / 100 + 64];
+    uLongf length = sizeof(compressed);
+    region_file *region;
+
+    if(!cache.open || !chunk->cache_dirty)
+        return;
+
+    region = get_region(chunk->x, chunk->z, true);
+    if(region == NULL)
+        return;
+
+    if(compress2(compressed, &length, (const Bytef *) chunk->data, COLUMN_BYTES, Z_BEST_SPEED) != Z_OK ||
+       !region_write_column(region, chunk->x, chunk->z, compressed, length, CHUNK_CACHE_COMPRESSION)) {
+        con_printf("chunk cache: failed to store column %d %d\n", chunk->x, chunk->z);
+        return;
+    }
+
+    chunk->cache_dirty = false;
+}
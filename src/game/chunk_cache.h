@@ -0,0 +1,20 @@
+#ifndef B173C_CHUNK_CACHE_H
+#define B173C_CHUNK_CACHE_H
+
+#include "world.h"
+
+/* columns the server sent are kept on disk in region files, one directory per server, so that
+ * they can be shown right away when the server announces them again (pre_chunk) instead of after
+ * the map_chunk arrives. whatever the server sends still overwrites them */
+
+#define CHUNK_CACHE_DIR "chunkcache"
+
+// the cache stays closed (and every call below does nothing) while cl_chunk_cache is 0
+void chunk_cache_open(const char *host, int port);
+void chunk_cache_close(void);
+
+// fills the data of a freshly allocated chunk, false if the column is not cached
+bool chunk_cache_load(world_chunk *chunk);
+void chunk_cache_store(world_chunk *chunk);
+
+#endif
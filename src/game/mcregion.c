@@ -0,0 +1,497 @@
+#include <zlib.h>
+#include <dirent.h>
+#include <SDL2/SDL.h>
+#include "mcregion.h"
+#include "region.h"
+#include "world.h"
+#include "client/client.h"
+#include "client/console.h"
+#include "client/cvar.h"
+#include "vid/vid.h"
+
+#define MAX_LOADER_THREADS 16
+
+/* a column in the layout of a whole column map_chunk packet: ids, then metadata, block light and
+ * sky light nibbles. beta saves use the same x, z, y order */
+#define COLUMN_BLOCKS (WORLD_CHUNK_SIZE * WORLD_CHUNK_SIZE * WORLD_CHUNK_HEIGHT)
+#define COLUMN_DATA_SIZE (COLUMN_BLOCKS * 5 / 2)
+
+enum {
+    TAG_END,
+    TAG_BYTE,
+    TAG_SHORT,
+    TAG_INT,
+    TAG_LONG,
+    TAG_FLOAT,
+    TAG_DOUBLE,
+    TAG_BYTE_ARRAY,
+    TAG_STRING,
+    TAG_LIST,
+    TAG_COMPOUND,
+    TAG_INT_ARRAY
+};
+
+#define NBT_MAX_DEPTH 64
+
+/* bounds checked reader, once something does not fit every read fails */
+struct nbt {
+    const ubyte *p, *end;
+    bool ok;
+};
+
+struct column_job {
+    const ubyte *src;
+    size_t size;
+    int x, z;
+    bool ok;
+    ubyte data[COLUMN_DATA_SIZE];
+};
+
+static struct {
+    struct column_job *jobs;
+    int num_jobs;
+    SDL_atomic_t next;
+} work;
+
+static bool nbt_has(struct nbt *n, size_t count)
+{
+    if(n->ok && (size_t) (n->end - n->p) < count)
+        n->ok = false;
+    return n->ok;
+}
+
+static const ubyte *nbt_take(struct nbt *n, size_t count)
+{
+    const ubyte *p = n->p;
+
+    if(!nbt_has(n, count))
+        return NULL;
+    n->p += count;
+    return p;
+}
+
+static int32_t nbt_read_int(struct nbt *n)
+{
+    const ubyte *p = nbt_take(n, 4);
+    return p ? (int32_t) ((uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 8 | p[3]) : 0;
+}
+
+static int nbt_read_short(struct nbt *n)
+{
+    const ubyte *p = nbt_take(n, 2);
+    return p ? p[0] << 8 | p[1] : 0;
+}
+
+static int nbt_read_byte(struct nbt *n)
+{
+    const ubyte *p = nbt_take(n, 1);
+    return p ? *p : TAG_END;
+}
+
+static void nbt_skip_payload(struct nbt *n, int type, int depth)
+{
+    static const size_t sizes[] = {
+            [TAG_BYTE] = 1, [TAG_SHORT] = 2, [TAG_INT] = 4, [TAG_LONG] = 8, [TAG_FLOAT] = 4, [TAG_DOUBLE] = 8
+    };
+    int32_t count;
+
+    if(depth > NBT_MAX_DEPTH)
+        n->ok = false;
+    if(!n->ok)
+        return;
+
+    switch(type) {
+    case TAG_BYTE: case TAG_SHORT: case TAG_INT: case TAG_LONG: case TAG_FLOAT: case TAG_DOUBLE:
+        nbt_take(n, sizes[type]);
+        break;
+    case TAG_BYTE_ARRAY:
+    case TAG_INT_ARRAY:
+        count = nbt_read_int(n);
+        if(count < 0)
+            n->ok = false;
+        else
+            nbt_take(n, (size_t) count * (type == TAG_INT_ARRAY ? 4 : 1));
+        break;
+    case TAG_STRING:
+        nbt_take(n, nbt_read_short(n));
+        break;
+    case TAG_LIST:
+        type = nbt_read_byte(n);
+        count = nbt_read_int(n);
+        for(int32_t i = 0; i < count && n->ok; i++)
+            nbt_skip_payload(n, type, depth + 1);
+        break;
+    case TAG_COMPOUND:
+        while(n->ok && (type = nbt_read_byte(n)) != TAG_END) {
+            nbt_take(n, nbt_read_short(n));
+            nbt_skip_payload(n, type, depth + 1);
+        }
+        break;
+    default:
+        n->ok = false;
+        break;
+    }
+}
+
+/* reads the type and name of the next tag of a compound, false at its end */
+static bool nbt_next_tag(struct nbt *n, int *type, const char **name, int *name_len)
+{
+    *type = nbt_read_byte(n);
+    if(!n->ok || *type == TAG_END)
+        return false;
+
+    *name_len = nbt_read_short(n);
+    *name = (const char *) nbt_take(n, *name_len);
+    return n->ok;
+}
+
+static bool nbt_name_is(const char *name, int name_len, const char *s)
+{
+    return (size_t) name_len == strlen(s) && !memcmp(name, s, name_len);
+}
+
+/* enters the root compound */
+static bool nbt_begin(struct nbt *n, const ubyte *data, size_t size)
+{
+    n->p = data;
+    n->end = data + size;
+    n->ok = true;
+
+    if(nbt_read_byte(n) != TAG_COMPOUND)
+        return false;
+    nbt_take(n, nbt_read_short(n));
+    return n->ok;
+}
+
+/* moves into the compound with the given name in the current compound */
+static bool nbt_find_compound(struct nbt *n, const char *wanted)
+{
+    const char *name;
+    int type, name_len;
+
+    while(nbt_next_tag(n, &type, &name, &name_len)) {
+        if(type == TAG_COMPOUND && nbt_name_is(name, name_len, wanted))
+            return true;
+        nbt_skip_payload(n, type, 0);
+    }
+
+    return false;
+}
+
+static bool parse_column(const ubyte *nbt_data, size_t size, struct column_job *job)
+{
+    static const struct {
+        const char *name;
+        size_t offset, length;
+    } arrays[] = {
+            {"Blocks", 0, COLUMN_BLOCKS},
+            {"Data", COLUMN_BLOCKS, COLUMN_BLOCKS / 2},
+            {"BlockLight", COLUMN_BLOCKS * 3 / 2, COLUMN_BLOCKS / 2},
+            {"SkyLight", COLUMN_BLOCKS * 2, COLUMN_BLOCKS / 2}
+    };
+    struct nbt n;
+    const char *name;
+    int type, name_len, found = 0;
+
+    if(!nbt_begin(&n, nbt_data, size) || !nbt_find_compound(&n, "Level"))
+        return false;
+
+    while(nbt_next_tag(&n, &type, &name, &name_len)) {
+        bool used = false;
+
+        if(type == TAG_INT && nbt_name_is(name, name_len, "xPos")) {
+            job->x = nbt_read_int(&n);
+            found |= 1 << 4;
+            continue;
+        }
+
+        if(type == TAG_INT && nbt_name_is(name, name_len, "zPos")) {
+            job->z = nbt_read_int(&n);
+            found |= 1 << 5;
+            continue;
+        }
+
+        for(int i = 0; i < 4 && type == TAG_BYTE_ARRAY && !used; i++) {
+            if(!nbt_name_is(name, name_len, arrays[i].name))
+                continue;
+
+            used = true;
+            if((size_t) nbt_read_int(&n) != arrays[i].length) {
+                n.ok = false;
+            } else {
+                const ubyte *src = nbt_take(&n, arrays[i].length);
+                if(src) {
+                    memcpy(&job->data[arrays[i].offset], src, arrays[i].length);
+                    found |= 1 << i;
+                }
+            }
+        }
+
+        if(!used)
+            nbt_skip_payload(&n, type, 0);
+    }
+
+    return n.ok && found == 63;
+}
+
+/* inflates into a buffer that is kept between calls and grown as needed. both zlib and gzip
+ * compressed columns are accepted */
+static bool inflate_column(const ubyte *src, size_t size, ubyte **buf, size_t *buf_size, size_t *out_size)
+{
+    z_stream strm = {0};
+    int ret;
+
+    if(inflateInit2(&strm, 32 + MAX_WBITS) != Z_OK)
+        return false;
+
+    strm.next_in = (Bytef *) src;
+    strm.avail_in = size;
+
+    do {
+        if(strm.total_out == *buf_size) {
+            *buf_size *= 2;
+            *buf = realloc(*buf, *buf_size);
+        }
+        strm.next_out = *buf + strm.total_out;
+        strm.avail_out = *buf_size - strm.total_out;
+        ret = inflate(&strm, Z_NO_FLUSH);
+    } while(ret == Z_OK);
+
+    *out_size = strm.total_out;
+    inflateEnd(&strm);
+    return ret == Z_STREAM_END;
+}
+
+static int worker(void *unused attr(unused))
+{
+    size_t buf_size = 1 << 18, size;
+    ubyte *buf = mem_alloc(buf_size);
+    int i;
+
+    while((i = SDL_AtomicAdd(&work.next, 1)) < work.num_jobs) {
+        struct column_job *job = &work.jobs[i];
+        job->ok = inflate_column(job->src, job->size, &buf, &buf_size, &size) && parse_column(buf, size, job);
+    }
+
+    mem_free(buf);
+    return 0;
+}
+
+static void run_jobs(void)
+{
+    SDL_Thread *threads[MAX_LOADER_THREADS];
+    int num_threads = bound(1, SDL_GetCPUCount(), MAX_LOADER_THREADS);
+
+    SDL_AtomicSet(&work.next, 0);
+
+    /* the calling thread is one of the workers */
+    for(int i = 1; i < num_threads; i++)
+        threads[i] = SDL_CreateThread(worker, "mcregion", NULL);
+
+    worker(NULL);
+
+    for(int i = 1; i < num_threads; i++) {
+        if(threads[i] != NULL)
+            SDL_WaitThread(threads[i], NULL);
+    }
+}
+
+static bool in_radius(int x, int z, int radius, int center_x, int center_z)
+{
+    return radius <= 0 || (abs(x - center_x) <= radius && abs(z - center_z) <= radius);
+}
+
+static size_t load_region(const char *path, int radius, int center_x, int center_z)
+{
+    region_file region;
+    const char *base = strrchr(path, '/');
+    int rx, rz, num_loaded = 0;
+    bool known_pos;
+
+    /* the file name tells which columns the region holds, so the radius can be checked before inflating */
+    base = base ? base + 1 : path;
+    known_pos = sscanf(base, "r.%d.%d.mcr", &rx, &rz) == 2;
+
+    if(!region_open(&region, path, false)) {
+        con_printf("failed to open '%s'\n", path);
+        return 0;
+    }
+
+    /* a job carries a whole inflated column, so only the columns the region actually has get one */
+    for(int pass = 0; pass < 2; pass++) {
+        work.num_jobs = 0;
+
+        for(int z = 0; z < REGION_SIZE; z++) {
+            for(int x = 0; x < REGION_SIZE; x++) {
+                const ubyte *src;
+                size_t size;
+                int compression;
+
+                if(known_pos && !in_radius(rx * REGION_SIZE + x, rz * REGION_SIZE + z, radius, center_x, center_z))
+                    continue;
+
+                src = region_get_column(&region, x, z, &size, &compression);
+                if(src == NULL || (compression != REGION_COMPRESSION_ZLIB && compression != REGION_COMPRESSION_GZIP))
+                    continue;
+
+                if(pass == 1) {
+                    work.jobs[work.num_jobs].src = src;
+                    work.jobs[work.num_jobs].size = size;
+                }
+                work.num_jobs++;
+            }
+        }
+
+        if(pass == 0) {
+            if(work.num_jobs == 0)
+                break;
+            work.jobs = mem_alloc(work.num_jobs * sizeof(*work.jobs));
+        }
+    }
+
+    if(work.num_jobs == 0) {
+        region_close(&region);
+        return 0;
+    }
+
+    run_jobs();
+
+    for(int i = 0; i < work.num_jobs; i++) {
+        struct column_job *job = &work.jobs[i];
+
+        if(!job->ok || !in_radius(job->x, job->z, radius, center_x, center_z))
+            continue;
+
+        world_load_chunk_data(job->x, job->z, job->data);
+        num_loaded++;
+    }
+
+    mem_free(work.jobs);
+    region_close(&region);
+    return num_loaded;
+}
+
+/* spawn point from level.dat, which is a gzipped nbt file */
+static bool read_spawn(const char *dir, int *x, int *y, int *z)
+{
+    static ubyte data[1 << 16];
+    gzFile f = gzopen(va("%s/level.dat", dir), "rb");
+    struct nbt n;
+    const char *name;
+    int type, name_len, size, found = 0;
+
+    if(f == NULL)
+        return false;
+
+    size = gzread(f, data, sizeof(data));
+    gzclose(f);
+
+    if(size <= 0 || !nbt_begin(&n, data, size) || !nbt_find_compound(&n, "Data"))
+        return false;
+
+    while(nbt_next_tag(&n, &type, &name, &name_len)) {
+        if(type == TAG_INT && nbt_name_is(name, name_len, "SpawnX")) {
+            *x = nbt_read_int(&n);
+            found |= 1;
+        } else if(type == TAG_INT && nbt_name_is(name, name_len, "SpawnY")) {
+            *y = nbt_read_int(&n);
+            found |= 2;
+        } else if(type == TAG_INT && nbt_name_is(name, name_len, "SpawnZ")) {
+            *z = nbt_read_int(&n);
+            found |= 4;
+        } else {
+            nbt_skip_payload(&n, type, 0);
+        }
+    }
+
+    return found == 7;
+}
+
+size_t mcregion_load_world(const char *path, int radius, vec3_t *spawn)
+{
+    char region_dir[512];
+    struct dirent *entry;
+    DIR *dir;
+    int sx = 0, sy = 64, sz = 0;
+    size_t len = strlen(path), num_loaded = 0;
+
+    if(len > 4 && !strcmp(path + len - 4, ".mcr")) {
+        num_loaded = load_region(path, 0, 0, 0);
+    } else {
+        read_spawn(path, &sx, &sy, &sz);
+
+        snprintf(region_dir, sizeof(region_dir), "%s/region", path);
+        dir = opendir(region_dir);
+        if(dir == NULL) {
+            con_printf("'%s' is not a world directory\n", path);
+            return 0;
+        }
+
+        while((entry = readdir(dir)) != NULL) {
+            len = strlen(entry->d_name);
+            if(len > 4 && !strcmp(entry->d_name + len - 4, ".mcr"))
+                num_loaded += load_region(va("%s/%s", region_dir, entry->d_name), radius, sx >> 4, sz >> 4);
+        }
+
+        closedir(dir);
+    }
+
+    /* standing on top of whatever is at the spawn point */
+    for(int y = WORLD_CHUNK_HEIGHT - 1; y > 0; y--) {
+        if(world_get_block(sx, y, sz).id != BLOCK_AIR) {
+            sy = y + 1;
+            break;
+        }
+    }
+
+    *spawn = vec3(sx + 0.5f, sy, sz + 0.5f);
+    return num_loaded;
+}
+
+void map_f(void)
+{
+    entity ent = {0};
+    uint64_t start;
+    size_t num_loaded;
+    int radius = 0;
+
+    if(cmd_argc() < 2) {
+        con_printf("usage: %s <world directory or .mcr file> [radius]\n", cmd_argv(0));
+        return;
+    }
+
+    if(cl.state != cl_disconnected) {
+        con_printf("disconnect first\n");
+        return;
+    }
+
+    if(cmd_argc() >= 3)
+        radius = strtol(cmd_argv(2), NULL, 10);
+
+    cl_end_game();
+
+    start = SDL_GetTicks64();
+    num_loaded = mcregion_load_world(cmd_argv(1), radius, &ent.position);
+    if(num_loaded == 0) {
+        con_printf("nothing loaded from '%s'\n", cmd_argv(1));
+        cl_end_game();
+        return;
+    }
+
+    con_printf("loaded %zu columns in %lu ms\n", num_loaded, (unsigned long) (SDL_GetTicks64() - start));
+
+    /* a local player to look around with, there is no server to hand one out */
+    ent.type = ENTITY_PLAYER;
+    ent.id = 0;
+    ent.eye_offset = 1.62f;
+    ent.position_old = ent.position;
+    ent.name = mem_alloc(strlen(cvar_name.string) + 1);
+    strcpy(ent.name, cvar_name.string);
+
+    cl.game.our_id = ent.id;
+    world_add_entity(&ent);
+    cl.state = cl_offline;
+
+    vid_unlock_fps();
+    con_hide();
+}
@@ -0,0 +1,17 @@
+#ifndef B173C_MCREGION_H
+#define B173C_MCREGION_H
+
+#include "common.h"
+#include "mathlib.h"
+
+/* loads the columns of a beta world save (<world>/region/r.X.Z.mcr) into the world, for looking
+ * around without a server. region files are memory mapped and their columns are inflated and
+ * parsed on all cores, the world itself is only touched from the calling thread.
+ * a radius (in chunks, around the spawn point) of 0 loads everything. returns the number of
+ * columns loaded, spawn receives the spawn point of the save */
+size_t mcregion_load_world(const char *path, int radius, vec3_t *spawn);
+
+// console command: map <world directory or .mcr file> [radius]
+void map_f(void);
+
+#endif
@@ -0,0 +1,121 @@
+import re
+import sys
+
+# usage: prepare_block_tables.py <output.c> <blocks.def> <block_ids.h>
+
+FLAGS = ["opaque", "solid", "collidable", "selectable", "fluid", "translucent", "flammable", "dyntex"]
+PASSES = ["opaque", "cutout", "translucent"]
+
+# ids missing from the definitions keep what the tables used to default to
+DEFAULT_FLAGS = {"solid", "collidable", "selectable"}
+
+
+def fail(line_no, msg):
+    sys.stderr.write(f"{sys.argv[2]}:{line_no}: {msg}\n")
+    sys.exit(1)
+
+
+def tile(expr, line_no):
+    if not re.fullmatch(r"[0-9+\-*]+", expr):
+        fail(line_no, f"bad texture index '{expr}'")
+    value = eval(expr)
+    if value < 0 or value > 255:
+        fail(line_no, f"texture index {expr} out of range")
+    return value
+
+
+ids = {}
+with open(sys.argv[3], "r") as f:
+    for m in re.finditer(r"BLOCK_(\w+)\s*=\s*(\d+)", f.read()):
+        ids[m.group(1)] = int(m.group(2))
+
+blocks = {}
+with open(sys.argv[2], "r") as f:
+    for line_no, line in enumerate(f.readlines(), 1):
+        line = line.split("#")[0].strip()
+        if line == "":
+            continue
+
+        fields = line.split()
+        if len(fields) < 6:
+            fail(line_no, "expected: id name hardness render textures flags")
+
+        name, key, hardness, render, textures = fields[:5]
+        if name not in ids:
+            fail(line_no, f"unknown block BLOCK_{name}")
+        if ids[name] in blocks:
+            fail(line_no, f"BLOCK_{name} is defined twice")
+
+        t = [tile(x, line_no) for x in textures.split("/")]
+        if len(t) == 1:
+            t = [t[0]] * 6
+        elif len(t) == 2: # topbot/side
+            t = [t[0], t[0]] + [t[1]] * 4
+        elif len(t) == 3: # top/bottom/side, faces are -y, +y, sides
+            t = [t[1], t[0]] + [t[2]] * 4
+        else:
+            fail(line_no, f"bad textures '{textures}'")
+
+        flags = set()
+        render_pass = None
+        for flag in fields[5:]:
+            if flag == "-":
+                continue
+            if flag.startswith("pass="):
+                render_pass = flag[5:]
+                if render_pass not in PASSES:
+                    fail(line_no, f"unknown render pass '{render_pass}'")
+            elif flag in FLAGS:
+                flags.add(flag)
+            else:
+                fail(line_no, f"unknown flag '{flag}'")
+
+        if render_pass is None:
+            if "translucent" in flags:
+                render_pass = "translucent"
+            elif "opaque" in flags:
+                render_pass = "opaque"
+            else:
+                render_pass = "cutout"
+
+        blocks[ids[name]] = {
+            "key": key,
+            "hardness": float(hardness),
+            "render": render.upper(),
+            "textures": t,
+            "flags": flags,
+            "pass": render_pass.upper(),
+        }
+
+f = open(sys.argv[1], "w+")
+
+f.write("/* generated by prepare_block_tables.py from blocks.def, do not edit */\n")
+f.write("#include \"game/block.h\"\n\n")
+
+f.write("block_properties block_defs[256] = {\n")
+for id, b in sorted(blocks.items()):
+    textures = ", ".join(str(x) for x in b["textures"])
+    f.write(f"    [{id}] = {{\"{b['key']}\", {b['hardness']}f, {{{textures}}}}},\n")
+f.write("};\n\n")
+
+f.write("uint64_t block_flags[BLOCK_FLAG_COUNT][4] = {\n")
+for flag in FLAGS:
+    words = [0, 0, 0, 0]
+    for id in range(256):
+        flags = blocks[id]["flags"] if id in blocks else DEFAULT_FLAGS
+        if flag in flags:
+            words[id >> 6] |= 1 << (id & 63)
+    f.write(f"    [BLOCK_FLAG_{flag.upper()}] = {{" + ", ".join(f"0x{w:016x}ull" for w in words) + "},\n")
+f.write("};\n\n")
+
+f.write("ubyte block_render_types[256] = {\n")
+for id, b in sorted(blocks.items()):
+    f.write(f"    [{id}] = RENDER_{b['render']},\n")
+f.write("};\n\n")
+
+f.write("ubyte block_render_passes[256] = {\n")
+for id in range(256):
+    f.write(f"    [{id}] = RENDER_PASS_{blocks[id]['pass'] if id in blocks else 'CUTOUT'},\n")
+f.write("};\n")
+
+f.close()
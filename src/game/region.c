@@ -0,0 +1,187 @@
+#include "region.h"
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#define HEADER_SECTORS 2
+
+static uint32_t read_be32(const ubyte *p)
+{
+    return (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 8 | p[3];
+}
+
+static void write_be32(ubyte *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static int column_index(int x, int z)
+{
+    return (x & (REGION_SIZE - 1)) + (z & (REGION_SIZE - 1)) * REGION_SIZE;
+}
+
+static void unmap(region_file *region)
+{
+    if(region->map == NULL)
+        return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(region->map);
+    CloseHandle(region->mapping);
+    region->mapping = NULL;
+#else
+    munmap((void *) region->map, region->map_size);
+#endif
+    region->map = NULL;
+    region->map_size = 0;
+}
+
+static bool remap(region_file *region)
+{
+    long size;
+
+    unmap(region);
+
+    if(fseek(region->file, 0, SEEK_END) != 0 || (size = ftell(region->file)) < HEADER_SECTORS * REGION_SECTOR_SIZE)
+        return false;
+
+#ifdef _WIN32
+    region->mapping = CreateFileMapping((HANDLE) _get_osfhandle(_fileno(region->file)), NULL, PAGE_READONLY, 0, 0, NULL);
+    if(region->mapping == NULL)
+        return false;
+    region->map = MapViewOfFile(region->mapping, FILE_MAP_READ, 0, 0, size);
+    if(region->map == NULL) {
+        CloseHandle(region->mapping);
+        region->mapping = NULL;
+        return false;
+    }
+#else
+    region->map = mmap(NULL, size, PROT_READ, MAP_SHARED, fileno(region->file), 0);
+    if(region->map == MAP_FAILED) {
+        region->map = NULL;
+        return false;
+    }
+#endif
+
+    region->map_size = size;
+    return true;
+}
+
+bool region_open(region_file *region, const char *path, bool writable)
+{
+    memset(region, 0, sizeof(*region));
+
+    region->file = fopen(path, writable ? "r+b" : "rb");
+    if(region->file == NULL && writable) {
+        static const ubyte empty_header[HEADER_SECTORS * REGION_SECTOR_SIZE];
+
+        region->file = fopen(path, "w+b");
+        if(region->file != NULL && fwrite(empty_header, sizeof(empty_header), 1, region->file) != 1) {
+            fclose(region->file);
+            region->file = NULL;
+        }
+        if(region->file != NULL)
+            fflush(region->file);
+    }
+
+    if(region->file == NULL)
+        return false;
+
+    if(!remap(region)) {
+        fclose(region->file);
+        region->file = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+void region_close(region_file *region)
+{
+    unmap(region);
+    if(region->file != NULL)
+        fclose(region->file);
+    region->file = NULL;
+}
+
+const ubyte *region_get_column(const region_file *region, int x, int z, size_t *size, int *compression)
+{
+    uint32_t location, length;
+    size_t offset, sectors;
+
+    if(region->map == NULL)
+        return NULL;
+
+    location = read_be32(&region->map[column_index(x, z) * 4]);
+    offset = (size_t) (location >> 8) * REGION_SECTOR_SIZE;
+    sectors = location & 255;
+
+    if(sectors == 0 || offset < HEADER_SECTORS * REGION_SECTOR_SIZE || offset + 5 > region->map_size)
+        return NULL;
+
+    /* the length includes the compression byte */
+    length = read_be32(&region->map[offset]);
+    if(length < 1 || length + 4 > sectors * REGION_SECTOR_SIZE || offset + 4 + length > region->map_size)
+        return NULL;
+
+    *compression = region->map[offset + 4];
+    *size = length - 1;
+    return &region->map[offset + 5];
+}
+
+bool region_write_column(region_file *region, int x, int z, const void *data, size_t size, int compression)
+{
+    static const ubyte padding[REGION_SECTOR_SIZE];
+    int index = column_index(x, z);
+    size_t needed = (size + 5 + REGION_SECTOR_SIZE - 1) / REGION_SECTOR_SIZE;
+    size_t offset, sectors;
+    uint32_t location;
+    ubyte head[5], entry[4];
+    bool ok;
+
+    if(region->map == NULL || needed > 255)
+        return false;
+
+    location = read_be32(&region->map[index * 4]);
+    offset = location >> 8;
+    sectors = location & 255;
+
+    /* rewritten in place if it still fits, otherwise appended. the old sectors are left unused */
+    if(offset < HEADER_SECTORS || needed > sectors) {
+        if(fseek(region->file, 0, SEEK_END) != 0)
+            return false;
+        offset = (ftell(region->file) + REGION_SECTOR_SIZE - 1) / REGION_SECTOR_SIZE;
+    }
+
+    write_be32(head, size + 1);
+    head[4] = compression;
+
+    ok = fseek(region->file, offset * REGION_SECTOR_SIZE, SEEK_SET) == 0;
+    ok = ok && fwrite(head, sizeof(head), 1, region->file) == 1;
+    ok = ok && fwrite(data, 1, size, region->file) == size;
+    ok = ok && fwrite(padding, 1, needed * REGION_SECTOR_SIZE - size - 5, region->file) == needed * REGION_SECTOR_SIZE - size - 5;
+
+    write_be32(entry, offset << 8 | needed);
+    ok = ok && fseek(region->file, index * 4, SEEK_SET) == 0;
+    ok = ok && fwrite(entry, sizeof(entry), 1, region->file) == 1;
+
+    write_be32(entry, time(NULL));
+    ok = ok && fseek(region->file, REGION_SECTOR_SIZE + index * 4, SEEK_SET) == 0;
+    ok = ok && fwrite(entry, sizeof(entry), 1, region->file) == 1;
+
+    ok = fflush(region->file) == 0 && ok;
+
+    if((offset + needed) * REGION_SECTOR_SIZE > region->map_size)
+        ok = remap(region) && ok;
+
+    return ok;
+}
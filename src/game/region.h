@@ -0,0 +1,36 @@
+#ifndef B173C_REGION_H
+#define B173C_REGION_H
+
+#include "common.h"
+#include <stdint.h>
+
+/* mcregion style container of 32x32 columns: a table of sector offsets, a table of timestamps,
+ * then every column in its own run of 4 KiB sectors as a big endian length, a compression byte
+ * and the payload. the file is memory mapped, so reading a column is just a pointer into the map.
+ * writes go through the file and the map is redone when the file grows */
+
+#define REGION_SIZE        32
+#define REGION_SECTOR_SIZE 4096
+
+#define REGION_COMPRESSION_GZIP 1
+#define REGION_COMPRESSION_ZLIB 2
+
+typedef struct {
+    FILE *file;
+    const ubyte *map;
+    size_t map_size;
+#ifdef _WIN32
+    void *mapping;
+#endif
+} region_file;
+
+// creates the file if writable and it does not exist yet
+bool region_open(region_file *region, const char *path, bool writable);
+void region_close(region_file *region);
+
+// the payload of a column (coordinates are taken modulo 32), NULL if the region does not have it
+const ubyte *region_get_column(const region_file *region, int x, int z, size_t *size, int *compression);
+
+bool region_write_column(region_file *region, int x, int z, const void *data, size_t size, int compression);
+
+#endif
@@ -7,13 +7,24 @@
 #include "entity.h"
 #include "block.h"
 #include "mathlib.h"
+#include "chunk_cache.h"
 
 static const block_data AIR_BLOCK_DATA = {.id = 0, .metadata = 0, .skylight = 15, .blocklight = 0};
 static const block_data EMPTY_BLOCK_DATA = {.id = 0, .metadata = 0, .skylight = 0, .blocklight = 0};
 static const block_data SOLID_BLOCK_DATA = {.id = 1, .metadata = 0, .skylight = 0, .blocklight = 0};
 
+#define CHUNK_BLOCKS (WORLD_CHUNK_SIZE * WORLD_CHUNK_SIZE * WORLD_CHUNK_HEIGHT)
+#define CHUNK_DATA_SIZE (CHUNK_BLOCKS * sizeof(block_data))
+
 struct hashmap *world_chunk_map = NULL;
 struct hashmap *world_entity_map = NULL;
+/* chunks the server unloaded, kept around (without gpu memory) in case they come back.
+ * the oldest ones are dropped when they take up more than world_max_memory_mb */
+static struct hashmap *world_cold_map = NULL;
+static size_t cold_bytes;
+static uint64_t cold_clock;
+/* bumped every time a chunk is added or removed, pointers into world_chunk_map may have moved when it changes */
+size_t world_chunk_map_version = 0;
 
 /* functions for the hashmaps */
 int chunk_compare(const void *a, const void *b, void *udata attr(unused))
@@ -37,6 +48,7 @@ void chunk_free(void *c)
 
     world_free_chunk_glbufs(chunk);
     mem_free(chunk->data);
+    mem_free(chunk->packed);
 }
 
 int entity_compare(const void *a, const void *b, void *udata attr(unused))
@@ -57,58 +69,258 @@ void entity_free(void *c)
     mem_free(ent->name);
 }
 
+/* runs of up to 256 equal blocks, stored as the run length - 1 and the block. y is the innermost
+ * axis of the data, so a column mostly turns into a few runs of stone, air and so on */
+static void pack_chunk(world_chunk *chunk)
+{
+    static ubyte buf[CHUNK_BLOCKS * (1 + sizeof(block_data))];
+    size_t n = 0;
+
+    for(size_t i = 0; i < CHUNK_BLOCKS;) {
+        size_t run = 1;
+
+        while(i + run < CHUNK_BLOCKS && run < 256 && !memcmp(&chunk->data[i + run], &chunk->data[i], sizeof(block_data)))
+            run++;
+
+        buf[n++] = run - 1;
+        memcpy(&buf[n], &chunk->data[i], sizeof(block_data));
+        n += sizeof(block_data);
+        i += run;
+    }
+
+    /* noise, not worth it */
+    if(n >= CHUNK_DATA_SIZE)
+        return;
+
+    chunk->packed = mem_alloc(n);
+    chunk->packed_size = n;
+    memcpy(chunk->packed, buf, n);
+    mem_free(chunk->data);
+}
+
+static void unpack_chunk(world_chunk *chunk)
+{
+    size_t n = 0, i = 0;
+
+    if(chunk->packed == NULL)
+        return;
+
+    chunk->data = mem_alloc(CHUNK_DATA_SIZE);
+
+    while(n + 1 + sizeof(block_data) <= chunk->packed_size) {
+        size_t run = chunk->packed[n++] + 1;
+        block_data block;
+
+        memcpy(&block, &chunk->packed[n], sizeof(block));
+        n += sizeof(block);
+
+        for(; run > 0 && i < CHUNK_BLOCKS; run--)
+            chunk->data[i++] = block;
+    }
+
+    mem_free(chunk->packed);
+    chunk->packed_size = 0;
+}
+
+static void world_meminfo_f(void)
+{
+    size_t loaded = 0, cold_raw = 0, cold_packed = 0, cold_meshes = 0, i = 0;
+    void *it;
+
+    while(hashmap_iter(world_chunk_map, &i, &it))
+        loaded += CHUNK_DATA_SIZE;
+
+    i = 0;
+    while(hashmap_iter(world_cold_map, &i, &it)) {
+        world_chunk *chunk = it;
+        cold_raw += CHUNK_DATA_SIZE;
+        cold_packed += chunk->packed ? chunk->packed_size : CHUNK_DATA_SIZE;
+        cold_meshes += chunk->gl.n_verts_complex * sizeof(struct vert_complex);
+    }
+
+    con_printf("loaded: %zu chunks, %zu KiB of blocks\n", hashmap_count(world_chunk_map), loaded / 1024);
+    con_printf("cold: %zu chunks, %zu KiB of blocks packed from %zu KiB (rle, %.1fx), %zu KiB of meshes\n",
+               hashmap_count(world_cold_map), cold_packed / 1024, cold_raw / 1024,
+               cold_packed > 0 ? (float) cold_raw / cold_packed : 0.0f, cold_meshes / 1024);
+    con_printf("cold budget: %zu of %d MiB used\n", cold_bytes >> 20, world_max_memory_mb.integer);
+}
+
 errcode world_init(void)
 {
     world_chunk_map = hashmap_new(sizeof(world_chunk), 0, 0, 0, chunk_hash, chunk_compare, chunk_free, NULL);
     world_entity_map = hashmap_new(sizeof(entity), 0, 0, 0, entity_hash, entity_compare, entity_free, NULL);
+    world_cold_map = hashmap_new(sizeof(world_chunk), 0, 0, 0, chunk_hash, chunk_compare, chunk_free, NULL);
 
-    if(world_chunk_map == NULL || world_entity_map == NULL)
+    if(world_chunk_map == NULL || world_entity_map == NULL || world_cold_map == NULL)
         return ERR_FATAL;
+
+    block_shapes_init();
+    block_textures_init();
+
+    cmd_register("world_meminfo", world_meminfo_f);
     return ERR_OK;
 }
 
+static void store_cached_chunks(struct hashmap *map)
+{
+    size_t i = 0;
+    void *it;
+
+    while(hashmap_iter(map, &i, &it)) {
+        world_chunk *chunk = it;
+
+        /* cold chunks are only stored when evicted, the ones still kept are written here */
+        if(chunk->cache_dirty) {
+            unpack_chunk(chunk);
+            chunk_cache_store(chunk);
+        }
+    }
+}
+
 void world_shutdown(void)
 {
+    store_cached_chunks(world_chunk_map);
+    store_cached_chunks(world_cold_map);
+    chunk_cache_close();
     hashmap_free(world_chunk_map);
     hashmap_free(world_entity_map);
+    hashmap_free(world_cold_map);
     world_chunk_map = NULL;
     world_entity_map = NULL;
+    world_cold_map = NULL;
 }
 
 void world_cleanup(void)
 {
+    store_cached_chunks(world_chunk_map);
+    store_cached_chunks(world_cold_map);
     hashmap_clear(world_chunk_map, true);
     hashmap_clear(world_entity_map, true);
+    hashmap_clear(world_cold_map, true);
+    cold_bytes = 0;
+    world_chunk_map_version++;
+}
+
+static size_t cold_chunk_size(const world_chunk *chunk)
+{
+    return (chunk->packed ? chunk->packed_size : CHUNK_DATA_SIZE) + chunk->gl.n_verts_complex * sizeof(struct vert_complex) +
+           chunk->gl.n_verts_simple * sizeof(struct vert_simple);
+}
+
+static void evict_cold_chunks(void)
+{
+    size_t budget = (size_t) max(world_max_memory_mb.integer, 0) << 20;
+
+    while(cold_bytes > budget && hashmap_count(world_cold_map) > 0) {
+        world_chunk *oldest = NULL, key;
+        size_t i = 0;
+        void *it;
+
+        while(hashmap_iter(world_cold_map, &i, &it)) {
+            world_chunk *chunk = it;
+            if(oldest == NULL || chunk->cold_since < oldest->cold_since)
+                oldest = chunk;
+        }
+
+        key = (world_chunk) {.x = oldest->x, .z = oldest->z};
+        cold_bytes -= cold_chunk_size(oldest);
+        if(oldest->cache_dirty) {
+            unpack_chunk(oldest);
+            chunk_cache_store(oldest);
+        }
+        chunk_free(oldest);
+        hashmap_delete(world_cold_map, &key);
+    }
+}
+
+void onchange_world_max_memory_mb(void)
+{
+    if(world_cold_map != NULL)
+        evict_cold_chunks();
+}
+
+ubyte world_get_chunk_neighbours(int chunk_x, int chunk_z)
+{
+    return world_chunk_exists(chunk_x - 1, chunk_z) << 0 | world_chunk_exists(chunk_x + 1, chunk_z) << 1 |
+           world_chunk_exists(chunk_x, chunk_z - 1) << 2 | world_chunk_exists(chunk_x, chunk_z + 1) << 3;
+}
+
+static bool restore_cold_chunk(int chunk_x, int chunk_z)
+{
+    world_chunk key = {.x = chunk_x, .z = chunk_z}, *cold, chunk;
+    bool reuse_mesh;
+
+    cold = (world_chunk *) hashmap_get(world_cold_map, &key);
+    if(cold == NULL)
+        return false;
+
+    chunk = *cold;
+    hashmap_delete(world_cold_map, &key);
+    cold_bytes -= cold_chunk_size(&chunk);
+    unpack_chunk(&chunk);
+
+    /* the blocks can't have changed while the server didn't send them, but the border faces
+     * of the mesh depend on which neighbours are there */
+    reuse_mesh = !chunk.gl.needs_remesh_complex && chunk.gl.mesh_neighbours == world_get_chunk_neighbours(chunk_x, chunk_z);
+
+    hashmap_set(world_chunk_map, &chunk);
+    world_chunk_map_version++;
+    world_restore_chunk_glbufs(world_get_chunk(chunk_x, chunk_z), reuse_mesh);
+    return true;
+}
+
+static void free_chunk(world_chunk *chunk, bool keep_cold)
+{
+    world_chunk key = {.x = chunk->x, .z = chunk->z};
+
+    /* cold chunks are written to the cache when they get evicted, so unloading doesn't wait on compressing */
+    if(keep_cold && world_max_memory_mb.integer > 0) {
+        world_chunk cold = *chunk;
+
+        world_release_chunk_glbufs(&cold);
+        pack_chunk(&cold);
+        cold.cold_since = ++cold_clock;
+        cold_bytes += cold_chunk_size(&cold);
+        hashmap_set(world_cold_map, &cold);
+    } else {
+        chunk_cache_store(chunk);
+        chunk_free(chunk);
+    }
+
+    hashmap_delete(world_chunk_map, &key);
+    world_chunk_map_version++;
+
+    evict_cold_chunks();
 }
 
-void world_alloc_chunk(int chunk_x, int chunk_z)
+bool world_alloc_chunk(int chunk_x, int chunk_z)
 {
     world_chunk chunk = {0};
 
+    /* a chunk that is allocated again starts over */
     if(world_chunk_exists(chunk_x, chunk_z))
-        world_free_chunk(chunk_x, chunk_z);
+        free_chunk(world_get_chunk(chunk_x, chunk_z), false);
+
+    if(restore_cold_chunk(chunk_x, chunk_z))
+        return true;
 
     chunk.x = chunk_x;
     chunk.z = chunk_z;
-    chunk.data = mem_alloc(WORLD_CHUNK_SIZE * WORLD_CHUNK_SIZE * WORLD_CHUNK_HEIGHT * sizeof(block_data));
+    chunk.data = mem_alloc(CHUNK_DATA_SIZE);
     world_init_chunk_glbufs(&chunk);
 
     /* the chunk is copied by hashmap_set, so it is fine to allocate it on the stack */
     hashmap_set(world_chunk_map, &chunk);
+    world_chunk_map_version++;
+    return false;
 }
 
 void world_free_chunk(int chunk_x, int chunk_z)
 {
-    world_chunk key = {.x = chunk_x, .z = chunk_z};
-    world_chunk *value;
+    world_chunk *value = world_get_chunk(chunk_x, chunk_z);
 
-    value = (world_chunk *) hashmap_get(world_chunk_map, &key);
-    if(!value)
-        return;
-
-    chunk_free(value);
-
-    hashmap_delete(world_chunk_map, &key);
+    if(value)
+        free_chunk(value, true);
 }
 
 bool world_chunk_exists(int chunk_x, int chunk_z)
@@ -143,6 +355,17 @@ void world_mark_region_for_remesh(int x_start, int y_start, int z_start, int x_e
     }
 }
 
+void world_mark_region_for_light(int x_start, int z_start, int x_end, int z_end)
+{
+    for(int cx = x_start >> 4; cx <= x_end >> 4; cx++) {
+        for(int cz = z_start >> 4; cz <= z_end >> 4; cz++) {
+            world_chunk *chunk = world_get_chunk(cx, cz);
+            if(chunk)
+                chunk->gl.needs_light_upload = true;
+        }
+    }
+}
+
 void world_mark_all_for_remesh(void)
 {
     void *it;
@@ -152,6 +375,14 @@ void world_mark_all_for_remesh(void)
         chunk->gl.needs_remesh_simple = true;
         chunk->gl.needs_remesh_complex = true;
     }
+
+    /* their meshes are out of date as well */
+    i = 0;
+    while(hashmap_iter(world_cold_map, &i, &it)) {
+        world_chunk *chunk = it;
+        chunk->gl.needs_remesh_simple = true;
+        chunk->gl.needs_remesh_complex = true;
+    }
 }
 
 static int inflate_data(ubyte *in, ubyte *out, size_t size_in, size_t size_out)
@@ -190,14 +421,20 @@ static int inflate_data(ubyte *in, ubyte *out, size_t size_in, size_t size_out)
     return Z_OK;
 }
 
+/* what world_set_chunk_data actually changed, light alone doesn't need a new mesh */
+#define CHUNK_CHANGED_BLOCKS 1
+#define CHUNK_CHANGED_LIGHT  2
+
 static int
 world_set_chunk_data(world_chunk *chunk, const ubyte *data, int x_start, int y_start, int z_start, int x_end, int y_end,
-                     int z_end, int data_pos)
+                     int z_end, int data_pos, int *changed)
 {
     for(int x = x_start; x < x_end; x++) {
         for(int z = z_start; z < z_end; z++) {
             for(int y = y_start; y < y_end; y++, data_pos++) {
                 int index = IDX_FROM_COORDS(x, y, z);
+                if(chunk->data[index].id != data[data_pos])
+                    *changed |= CHUNK_CHANGED_BLOCKS;
                 chunk->data[index].id = data[data_pos];
             }
         }
@@ -208,8 +445,10 @@ world_set_chunk_data(world_chunk *chunk, const ubyte *data, int x_start, int y_s
             bool next = false;
             for(int y = y_start; y < y_end; y++) {
                 int index = IDX_FROM_COORDS(x, y, z);
-                ubyte value = data[data_pos];
-                chunk->data[index].metadata = !(y & 1) ? (value & 15) : ((value >> 4) & 15);
+                ubyte value = !(y & 1) ? (data[data_pos] & 15) : ((data[data_pos] >> 4) & 15);
+                if(chunk->data[index].metadata != value)
+                    *changed |= CHUNK_CHANGED_BLOCKS;
+                chunk->data[index].metadata = value;
                 if(next)
                     data_pos++;
                 next = !next;
@@ -222,8 +461,10 @@ world_set_chunk_data(world_chunk *chunk, const ubyte *data, int x_start, int y_s
             bool next = false;
             for(int y = y_start; y < y_end; y++) {
                 int index = IDX_FROM_COORDS(x, y, z);
-                ubyte value = data[data_pos];
-                chunk->data[index].blocklight = !(y & 1) ? (value & 15) : ((value >> 4) & 15);
+                ubyte value = !(y & 1) ? (data[data_pos] & 15) : ((data[data_pos] >> 4) & 15);
+                if(chunk->data[index].blocklight != value)
+                    *changed |= CHUNK_CHANGED_LIGHT;
+                chunk->data[index].blocklight = value;
                 if(next)
                     data_pos++;
                 next = !next;
@@ -236,8 +477,10 @@ world_set_chunk_data(world_chunk *chunk, const ubyte *data, int x_start, int y_s
             bool next = false;
             for(int y = y_start; y < y_end; y++) {
                 int index = IDX_FROM_COORDS(x, y, z);
-                ubyte value = data[data_pos];
-                chunk->data[index].skylight = !(y & 1) ? (value & 15) : ((value >> 4) & 15);
+                ubyte value = !(y & 1) ? (data[data_pos] & 15) : ((data[data_pos] >> 4) & 15);
+                if(chunk->data[index].skylight != value)
+                    *changed |= CHUNK_CHANGED_LIGHT;
+                chunk->data[index].skylight = value;
                 if(next)
                     data_pos++;
                 next = !next;
@@ -286,6 +529,8 @@ void world_load_compressed_chunk_data(int x, int y, int z, int sx, int sy, int s
         for(int cz = chunk_z_start; cz <= chunk_z_end; cz++) {
             int z_start = z - cz * 16;
             int z_end = z + sz - cz * 16;
+            world_chunk *chunk;
+            int changed = 0;
 
             if(z_start < 0)
                 z_start = 0;
@@ -296,13 +541,41 @@ void world_load_compressed_chunk_data(int x, int y, int z, int sx, int sy, int s
             if(!world_chunk_exists(cx, cz))
                 world_alloc_chunk(cx, cz);
 
-            world_mark_region_for_remesh(cx * 16 + x_start - 1, y_start - 1, cz * 16 + z_start - 1, cx * 16 + x_end + 1,
-                                         y_end + 1, cz * 16 + z_end + 1);
-            i = world_set_chunk_data(world_get_chunk(cx, cz), data, x_start, y_start, z_start, x_end, y_end, z_end, i);
+            chunk = world_get_chunk(cx, cz);
+            i = world_set_chunk_data(chunk, data, x_start, y_start, z_start, x_end, y_end, z_end, i, &changed);
+
+            /* a chunk that came back from the cold chunks mostly gets sent the very same blocks
+             * again, its old mesh stays good then. the light lives in its own texture, so a change
+             * of only the light just uploads that again */
+            if(!chunk->gl.meshed || (changed & CHUNK_CHANGED_BLOCKS)) {
+                world_mark_region_for_remesh(cx * 16 + x_start - 1, y_start - 1, cz * 16 + z_start - 1,
+                                             cx * 16 + x_end + 1, y_end + 1, cz * 16 + z_end + 1);
+            } else if(changed & CHUNK_CHANGED_LIGHT) {
+                world_mark_region_for_light(cx * 16 + x_start - 1, cz * 16 + z_start - 1,
+                                            cx * 16 + x_end + 1, cz * 16 + z_end + 1);
+            }
+            if(changed)
+                chunk->cache_dirty = true;
         }
     }
 }
 
+void world_load_chunk_data(int chunk_x, int chunk_z, const ubyte *data)
+{
+    world_chunk *chunk;
+    int changed = 0;
+
+    if(!world_chunk_exists(chunk_x, chunk_z))
+        world_alloc_chunk(chunk_x, chunk_z);
+
+    chunk = world_get_chunk(chunk_x, chunk_z);
+    world_set_chunk_data(chunk, data, 0, 0, 0, WORLD_CHUNK_SIZE, WORLD_CHUNK_HEIGHT, WORLD_CHUNK_SIZE, 0, &changed);
+    chunk->cache_dirty = true;
+
+    world_mark_region_for_remesh((chunk_x << 4) - 1, 0, (chunk_z << 4) - 1, (chunk_x << 4) + WORLD_CHUNK_SIZE,
+                                 WORLD_CHUNK_HEIGHT - 1, (chunk_z << 4) + WORLD_CHUNK_SIZE);
+}
+
 block_data world_get_blockf(float x, float y, float z)
 {
     return world_get_block((int) floorf(x), (int) floorf(y), (int) floorf(z));
@@ -367,7 +640,7 @@ bool block_should_face_be_rendered_fast(world_chunk *chunk, int x, int y, int z,
         if(other.id == self.id)
             return false;
 
-    if(block_get_properties(self.id).render_type == RENDER_FLUID) {
+    if(block_get_render_type(self.id) == RENDER_FLUID) {
         if(face == BLOCK_FACE_Y_POS) {
             return true;
         }
@@ -375,49 +648,6 @@ bool block_should_face_be_rendered_fast(world_chunk *chunk, int x, int y, int z,
     return block_is_transparent(other);
 }
 
-void add_stair_bboxes(bbox_t *colliders, size_t *n_colliders, block_data block, int x, int y, int z, bbox_t box)
-{
-    int facing = block.metadata;
-    bbox_t bb;
-    switch(facing) {
-    case 0:
-        bb = (bbox_t) {vec3(x, y, z), vec3(x + 0.5f, y + 0.5f, z + 1)};
-        if(bbox_intersects(bb, box))
-            colliders[(*n_colliders)++] = bb;
-        bb = (bbox_t) {vec3(x + 0.5f, y, z), vec3(x + 1, y + 1, z + 1)};
-        if(bbox_intersects(bb, box))
-            colliders[(*n_colliders)++] = bb;
-        break;
-    case 1:
-        bb = (bbox_t) {vec3(x, y, z), vec3(x + 0.5f, y + 1, z + 1)};
-        if(bbox_intersects(bb, box))
-            colliders[(*n_colliders)++] = bb;
-        bb = (bbox_t) {vec3(x + 0.5f, y, z), vec3(x + 1, y + 0.5f, z + 1)};
-        if(bbox_intersects(bb, box))
-            colliders[(*n_colliders)++] = bb;
-        break;
-    case 2:
-        bb = (bbox_t) {vec3(x, y, z), vec3(x + 1, y + 0.5f, z + 0.5f)};
-        if(bbox_intersects(bb, box))
-            colliders[(*n_colliders)++] = bb;
-        bb = (bbox_t) {vec3(x, y, z + 0.5f), vec3(x + 1, y + 1, z + 1)};
-        if(bbox_intersects(bb, box))
-            colliders[(*n_colliders)++] = bb;
-        break;
-    case 3:
-        bb = (bbox_t) {vec3(x, y, z), vec3(x + 1, y + 1, z + 0.5f)};
-        if(bbox_intersects(bb, box))
-            colliders[(*n_colliders)++] = bb;
-        bb = (bbox_t) {vec3(x, y, z + 0.5f), vec3(x + 1, y + 0.5f, z + 1)};
-        if(bbox_intersects(bb, box))
-            colliders[(*n_colliders)++] = bb;
-        break;
-    default:
-        break;
-    }
-
-}
-
 bbox_t *world_get_colliding_blocks(bbox_t box)
 {
     static bbox_t colliders[64] = {0};
@@ -436,18 +666,13 @@ bbox_t *world_get_colliding_blocks(bbox_t box)
         for(int z = z0; z < z1; z++) {
             for(int y = y0 - 1; y < y1; y++) {
                 block_data block = world_get_block(x, y, z);
-                if(block_is_collidable(block)) {
-                    if((block.id == BLOCK_STAIRS_STONE || block.id == BLOCK_STAIRS_WOOD) && n_colliders < 62) {
-                        add_stair_bboxes(colliders, &n_colliders, block, x, y, z, box);
-                    } else {
-                        bbox_t bb = block_get_bbox(block, x, y, z, false);
-                        if(!bbox_null(bb) && bbox_intersects(box, bb)) {
-                            colliders[n_colliders++] = bb;
-                        }
-                    }
-                    if(n_colliders >= 63) {
+                const block_shape *shape = block_get_shape(block, false);
+                for(int i = 0; i < shape->count; i++) {
+                    bbox_t bb = bbox_offset(shape->boxes[i], vec3(x, y, z));
+                    if(bbox_intersects(box, bb))
+                        colliders[n_colliders++] = bb;
+                    if(n_colliders >= 63)
                         goto end; // realistically shouldn't happen
-                    }
                 }
             }
         }
@@ -530,6 +755,7 @@ void world_set_block(int x, int y, int z, block_data data)
     world_mark_region_for_remesh(x - 1, y - 1, z - 1, x + 1, y + 1, z + 1);
 
     chunk->data[IDX_FROM_COORDS(x, y, z)] = data;
+    chunk->cache_dirty = true;
 }
 
 void world_set_block_id(int x, int y, int z, block_id new_id)
@@ -621,6 +847,7 @@ struct trace_result world_trace_ray(vec3_t origin, vec3_t dir, float maxlen)
     vec3_t delta = {0};
     vec3_t edgedist = {0};
     vec3_t end = vec3_add(origin, vec3_mul(dir, maxlen));
+    const block_shape *shape;
 
     for(int axis = 0; axis < 3; axis++) {
         delta.array[axis] = dir.array[axis] == 0.0f ? 9999.0f : fabsf(1.0f / dir.array[axis]);
@@ -663,8 +890,10 @@ struct trace_result world_trace_ray(vec3_t origin, vec3_t dir, float maxlen)
             break;
 
         res.block = world_get_block(res.x, res.y, res.z);
-        if(block_is_selectable(res.block)) {
-            bbox_t bbox = block_get_bbox(res.block, res.x, res.y, res.z, true);
+        shape = block_get_shape(res.block, true);
+        if(shape->count > 0) {
+            bbox_t bbox = shape->dynamic ? block_get_bbox(res.block, res.x, res.y, res.z, true) :
+                                           bbox_offset(shape->boxes[0], vec3(res.x, res.y, res.z));
             int face = res.hit_face;
             if(bbox_intersects_line(bbox, origin, end, &face)) {
                 res.reached_end = false;
@@ -10,6 +10,7 @@
 // todo: start using this xd
 #define WORLD_CHUNK_SIZE   16
 #define WORLD_CHUNK_HEIGHT 128
+#define WORLD_CHUNK_SECTIONS (WORLD_CHUNK_HEIGHT / WORLD_CHUNK_SIZE)
 
 #define IDX_FROM_COORDS(x, y, z) ((((x) & 15) << 11) | (((z) & 15) << 7) | ((y) & 127))
 
@@ -20,12 +21,28 @@ typedef struct {
      * WORLD_CHUNK_SIZE * WORLD_CHUNK_SIZE * WORLD_CHUNK_HEIGHT
      * elements */
     block_data *data;
+    /* cold chunks keep their blocks run length encoded here instead, data is NULL then */
+    ubyte *packed;
+    size_t packed_size;
+
+    /* changed since it was last stored in or loaded from the chunk cache */
+    bool cache_dirty;
+    /* when it was unloaded, for evicting the oldest cold chunk first */
+    uint64_t cold_since;
 
     /* rendering related */
     struct chunk_render_data {
         bool visible;
+        /* meshed at least once */
+        bool meshed;
+        /* world_get_chunk_neighbours() when the mesh was built */
+        ubyte mesh_neighbours;
+        /* drawn at full detail this frame, otherwise the lod renderer covers it */
+        bool detailed;
         bool needs_remesh_simple;
         bool needs_remesh_complex;
+        /* only the light changed, the mesh is still good */
+        bool needs_light_upload;
 
         struct vert_simple {
             // XXXXXYYY
@@ -49,27 +66,57 @@ typedef struct {
         } attr(packed) *verts_complex;
 
         size_t n_verts_simple, n_verts_complex;
-        uint32_t vbo_simple, vbo_complex;
-        uint32_t light_tex;
+        /* verts_complex is split into one range per render pass and 16x16x16 section,
+         * the sections of a pass are stored one after another */
+        size_t pass_first[RENDER_PASS_COUNT][WORLD_CHUNK_SECTIONS];
+        size_t pass_count[RENDER_PASS_COUNT][WORLD_CHUNK_SECTIONS];
+        /* bit (a * 6 + b) is set when face b of a section can be reached from face a
+         * through non-opaque blocks */
+        uint64_t section_connectivity[WORLD_CHUNK_SECTIONS];
+        /* sections made only of opaque blocks, used as occluders */
+        ubyte opaque_sections;
+        /* sections that passed the visibility search this frame */
+        ubyte visible_sections;
+        /* sections inside the view frustum this frame */
+        ubyte frustum_sections;
+        /* sections meshed at full detail (foliage, plants), see r_detail_distance */
+        ubyte detail_sections;
+        /* index of the first section in the renderer's bounds table */
+        size_t bounds_index;
+        /* ranges of the vertices in the renderer's vertex heaps */
+        size_t simple_heap_offset, simple_heap_count;
+        size_t heap_offset, heap_count;
+        /* index into the per-chunk info buffer and the light atlas, -1 if none could be allocated */
+        int slot;
     } gl;
 } world_chunk;
 
 extern struct hashmap *world_chunk_map;
+extern size_t world_chunk_map_version;
 
 errcode world_init(void);
 void world_shutdown(void);
 void world_cleanup(void);
 // fixme
-#define world_is_init() (cl.state == cl_connected && world_chunk_map != NULL)
+#define world_is_init() (cl.state >= cl_connected && world_chunk_map != NULL)
 
 /* chunks */
-void world_alloc_chunk(int chunk_x, int chunk_z);
+// true if the chunk came back from the cold chunks with its blocks (and maybe its mesh)
+bool world_alloc_chunk(int chunk_x, int chunk_z);
+// while world_max_memory_mb allows it, the blocks and mesh are kept in ram as a cold chunk
+// and only the gpu side is released
 void world_free_chunk(int chunk_x, int chunk_z);
 bool world_chunk_exists(int chunk_x, int chunk_z);
 world_chunk *world_get_chunk(int chunk_x, int chunk_z);
 void world_mark_region_for_remesh(int x_start, int y_start, int z_start, int x_end, int y_end, int z_end);
+// the light texture of the columns is uploaded again, the meshes stay
+void world_mark_region_for_light(int x_start, int z_start, int x_end, int z_end);
 void world_mark_all_for_remesh(void);
+// bit n is set if the neighbour on side n (-x, +x, -z, +z) is loaded
+ubyte world_get_chunk_neighbours(int chunk_x, int chunk_z);
 void world_load_compressed_chunk_data(int x, int y, int z, int sx, int sy, int sz, size_t size, ubyte *data);
+// a whole column in the layout of the map_chunk packet
+void world_load_chunk_data(int chunk_x, int chunk_z, const ubyte *data);
 
 /* blocks */
 // todo: define in block.c maybe
@@ -108,5 +155,16 @@ void world_renderer_shutdown(void);
 void world_render(void);
 void world_init_chunk_glbufs(world_chunk *c);
 void world_free_chunk_glbufs(world_chunk *c);
+// for cold chunks: gpu memory is given back, the cpu copy of the mesh stays
+void world_release_chunk_glbufs(world_chunk *c);
+void world_restore_chunk_glbufs(world_chunk *c, bool reuse_mesh);
+// frustum of the last world_render
+bool world_renderer_bbox_on_frustum(bbox_t box);
+
+/* far terrain */
+void lod_renderer_init(void);
+void lod_renderer_shutdown(void);
+void lod_renderer_render(vec3_t cam_pos);
+void lod_renderer_update_column(world_chunk *chunk);
 
 #endif
@@ -277,7 +277,7 @@ static void handle_keys(void)
         }
     }
 
-    if(cl.state == cl_connected) {
+    if(cl.state >= cl_connected) {
         player_update(cl.game.our_ent, gamekeys);
     }
 
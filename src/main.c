@@ -9,6 +9,7 @@
 #include "client/client.h"
 #include "assets.h"
 #include "client/cvar.h"
+#include "game/chunk_cache.h"
 
 #define TPS 20
 
@@ -102,6 +103,8 @@ void check_stuck(void)
 void cl_end_game(void)
 {
     world_cleanup();
+    lod_renderer_clear();
+    chunk_cache_close();
     memset(&cl.game, 0, sizeof(cl.game));
     cl.game.our_ent = &dummy_ent;
 }
@@ -160,6 +163,7 @@ int main(int argc, char **argv)
     entity_renderer_shutdown();
     ui_shutdown();
     vid_shutdown();
+    con_shutdown();
 
     return 0;
 }
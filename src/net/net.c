@@ -32,6 +32,7 @@
 #include "client/client.h"
 #include "client/console.h"
 #include "vid/vid.h"
+#include "game/chunk_cache.h"
 #include <setjmp.h>
 #include <uchar.h>
 #include "packets.h"
@@ -155,7 +156,7 @@ void net_process(void)
         return;
 
     // read and handle incoming packets
-    if(cl.state > cl_disconnected) {
+    if(cl.state == cl_connecting || cl.state == cl_connected) {
         if(setjmp(read_abort)) {
             // longjmp to here means that recv failed, which usually
             // means we did not receive enough data to read an entire packet
@@ -586,6 +587,7 @@ void connect_f(void)
 
     if(info != NULL) {
         net_init();
+        chunk_cache_open(addrstr, port);
         net_connect((struct sockaddr_in *) info->ai_addr, port);
     }
 
@@ -594,6 +596,14 @@ void connect_f(void)
 
 void disconnect_f(void)
 {
+    if(cl.state == cl_offline) {
+        vid_lock_fps();
+        cl_end_game();
+        cl.state = cl_disconnected;
+        con_show();
+        return;
+    }
+
     if(cl.state != cl_disconnected) {
         vid_lock_fps();
         cl_end_game();
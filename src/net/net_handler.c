@@ -1,5 +1,6 @@
 #include "net_internal.h"
 #include "game/world.h"
+#include "game/chunk_cache.h"
 #include "client/console.h"
 #include "client/client.h"
 #include "client/cvar.h"
@@ -393,7 +394,9 @@ void net_handle_pkt_entity_metadata(pkt_entity_metadata pkt)
 void net_handle_pkt_pre_chunk(pkt_pre_chunk pkt)
 {
 	if(pkt.load) {
-		world_alloc_chunk(pkt.x, pkt.z);
+		/* shown from memory or the disk cache until the map_chunk packet replaces it */
+		if(!world_alloc_chunk(pkt.x, pkt.z))
+			chunk_cache_load(world_get_chunk(pkt.x, pkt.z));
 	} else {
 		world_free_chunk(pkt.x, pkt.z);
 	}
@@ -4,15 +4,44 @@
 #include "client/client.h"
 #include "glad/glad.h"
 #include "game/entity.h"
+#include "game/world.h"
 #include "hashmap.c/hashmap.h"
 #include "ui.h"
 #include "client/cvar.h"
 
-uint32_t gl_vao, gl_vbo;
-GLint gl_uniform_model, gl_uniform_view, gl_uniform_projection;
+/* every model lives in the same vertex buffer, entities of one model are drawn with a single
+ * instanced draw. the per-instance data is the model matrix, rebuilt every frame for the
+ * entities on the frustum and sorted by model */
+enum {
+    ENTITY_MODEL_PLACEHOLDER,
+    ENTITY_MODEL_COUNT
+};
+
+static const struct entity_model {
+    GLint first;
+    GLsizei count;
+    float radius; // around the entity position, for culling
+} entity_models[ENTITY_MODEL_COUNT] = {
+    [ENTITY_MODEL_PLACEHOLDER] = {0, 3, 1.0f},
+};
+
+// entity_type -> model, anything without a model of its own gets the placeholder
+static const ubyte entity_model_lookup[256] = {0};
+
+uint32_t gl_vao, gl_vbo, gl_instance_vbo;
+GLint gl_uniform_view, gl_uniform_projection;
 extern struct gl_state gl;
 extern mat4_t view_mat, proj_mat;
 
+static struct {
+    mat4_t *models;
+    ubyte *model_ids;
+    size_t count, capacity;
+
+    mat4_t *sorted;
+    size_t sorted_capacity;
+} instances;
+
 errcode entity_renderer_init(void)
 {
     vec3_t entity_model_verts[] = {
@@ -23,15 +52,23 @@ errcode entity_renderer_init(void)
 
     glGenVertexArrays(1, &gl_vao);
     glGenBuffers(1, &gl_vbo);
+    glGenBuffers(1, &gl_instance_vbo);
 
     glBindVertexArray(gl_vao);
         glBindBuffer(GL_ARRAY_BUFFER, gl_vbo);
         glBufferData(GL_ARRAY_BUFFER, sizeof(entity_model_verts), entity_model_verts, GL_STATIC_DRAW);
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vec3_t), 0);
         glEnableVertexAttribArray(0);
+
+        // instance data, a mat4 takes 4 attribute locations
+        glBindBuffer(GL_ARRAY_BUFFER, gl_instance_vbo);
+        for(int i = 0; i < 4; i++) {
+            glVertexAttribPointer(1 + i, 4, GL_FLOAT, GL_FALSE, sizeof(mat4_t), (void *) (i * sizeof(vec4_t)));
+            glEnableVertexAttribArray(1 + i);
+            glVertexAttribDivisor(1 + i, 1);
+        }
     glBindVertexArray(0);
 
-    gl_uniform_model = glGetUniformLocation(gl.shader_model, "MODEL");
     gl_uniform_view = glGetUniformLocation(gl.shader_model, "VIEW");
     gl_uniform_projection = glGetUniformLocation(gl.shader_model, "PROJECTION");
 
@@ -44,33 +81,55 @@ void entity_renderer_shutdown(void)
 {
     glDeleteVertexArrays(1, &gl_vao);
     glDeleteBuffers(1, &gl_vbo);
+    glDeleteBuffers(1, &gl_instance_vbo);
+
+    mem_free(instances.models);
+    mem_free(instances.model_ids);
+    mem_free(instances.sorted);
+    instances.count = instances.capacity = instances.sorted_capacity = 0;
 }
 
-void entity_renderer_render(void)
+static void add_instance(const entity *ent, int model_id)
 {
-    size_t i;
-    void *it;
+    mat4_t t, r;
 
-    glUniformMatrix4fv(gl_uniform_view, 1, GL_FALSE, (const GLfloat *) view_mat);
-    glUniformMatrix4fv(gl_uniform_projection, 1, GL_FALSE, (const GLfloat *) proj_mat);
+    if(instances.count == instances.capacity) {
+        instances.capacity = instances.capacity ? instances.capacity * 2 : 64;
+        instances.models = realloc(instances.models, instances.capacity * sizeof(mat4_t));
+        instances.model_ids = realloc(instances.model_ids, instances.capacity);
+    }
 
-    glBindVertexArray(gl_vao);
+    mat4_identity(t);
+    mat4_identity(r);
+    mat4_translation(t, ent->position);
+    mat4_rotation(r, ent->rotation);
+    mat4_multiply(instances.models[instances.count], r, t);
+    instances.model_ids[instances.count] = model_id;
+    instances.count++;
+}
 
-    glDisable(GL_CULL_FACE);
+void entity_renderer_render(void)
+{
+    size_t i, first[ENTITY_MODEL_COUNT] = {0}, counts[ENTITY_MODEL_COUNT] = {0};
+    void *it;
+
+    /* gather the visible entities */
+    instances.count = 0;
     i = 0;
     while(hashmap_iter(world_entity_map, &i, &it)) {
         entity *ent = it;
-        mat4_t model, t, r;
+        int model_id = entity_model_lookup[ent->type & 255];
+        float radius = entity_models[model_id].radius;
+        bbox_t bounds;
         vec3_t text_pos;
 
         if(ent == cl.game.our_ent && cl_freecamera.integer == 0)
             continue;
 
-        mat4_identity(t);
-        mat4_identity(r);
-        mat4_translation(t, ent->position);
-        mat4_rotation(r, ent->rotation);
-        mat4_multiply(model, r, t);
+        bounds.mins = vec3_sub(ent->position, vec3(radius, radius, radius));
+        bounds.maxs = vec3_add(ent->position, vec3(radius, radius, radius));
+        if(!world_renderer_bbox_on_frustum(bounds))
+            continue;
 
         if(developer.integer >= 2) {
             text_pos = cam_project_3d_to_2d(ent->position, proj_mat, view_mat, vec2(ui_w, ui_h));
@@ -79,8 +138,46 @@ void entity_renderer_render(void)
             }
         }
 
-        glUniformMatrix4fv(gl_uniform_model, 1, GL_FALSE, (const GLfloat *) model);
-        glDrawArrays(GL_TRIANGLE_STRIP, 0, 3);
+        add_instance(ent, model_id);
+        counts[model_id]++;
+    }
+
+    if(instances.count == 0)
+        return;
+
+    /* counting sort by model so that every model is one contiguous run of instances */
+    for(int m = 1; m < ENTITY_MODEL_COUNT; m++)
+        first[m] = first[m - 1] + counts[m - 1];
+
+    if(instances.sorted_capacity < instances.capacity) {
+        instances.sorted_capacity = instances.capacity;
+        instances.sorted = realloc(instances.sorted, instances.sorted_capacity * sizeof(mat4_t));
+    }
+
+    {
+        size_t next[ENTITY_MODEL_COUNT];
+        memcpy(next, first, sizeof(next));
+        for(i = 0; i < instances.count; i++)
+            memcpy(instances.sorted[next[instances.model_ids[i]]++], instances.models[i], sizeof(mat4_t));
+    }
+
+    glUniformMatrix4fv(gl_uniform_view, 1, GL_FALSE, (const GLfloat *) view_mat);
+    glUniformMatrix4fv(gl_uniform_projection, 1, GL_FALSE, (const GLfloat *) proj_mat);
+
+    glBindBuffer(GL_ARRAY_BUFFER, gl_instance_vbo);
+    glBufferData(GL_ARRAY_BUFFER, instances.count * sizeof(mat4_t), instances.sorted, GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glBindVertexArray(gl_vao);
+
+    glDisable(GL_CULL_FACE);
+    for(int m = 0; m < ENTITY_MODEL_COUNT; m++) {
+        const struct entity_model *model = &entity_models[m];
+
+        if(counts[m] == 0)
+            continue;
+
+        glDrawArraysInstancedBaseInstance(GL_TRIANGLE_STRIP, model->first, model->count, counts[m], first[m]);
     }
     glEnable(GL_CULL_FACE);
 
@@ -0,0 +1,385 @@
+#include "gpu_heap.h"
+#include "glad/glad.h"
+
+#define MAX_STAGING_FENCES 64
+
+/* ring buffer that the cpu writes into and the gpu copies out of. the cpu never waits
+ * unless it is about to overwrite bytes that a copy still in flight may be reading */
+static struct {
+    bool init, persistent;
+    uint32_t buffer;
+    ubyte *map;
+
+    /* both only ever grow, the difference is what the gpu may still be reading */
+    uint64_t written, retired;
+    uint64_t fenced; // value of written when the last fence was placed
+
+    struct staging_fence {
+        GLsync sync;
+        uint64_t written;
+    } fences[MAX_STAGING_FENCES];
+    int first_fence, num_fences;
+} staging;
+
+static void staging_init(void)
+{
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+    staging.init = true;
+
+    if(!GLAD_GL_VERSION_4_4)
+        return;
+
+    glGenBuffers(1, &staging.buffer);
+    glBindBuffer(GL_COPY_READ_BUFFER, staging.buffer);
+    glBufferStorage(GL_COPY_READ_BUFFER, GPU_HEAP_STAGING_SIZE, NULL, flags);
+    staging.map = glMapBufferRange(GL_COPY_READ_BUFFER, 0, GPU_HEAP_STAGING_SIZE, flags);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+    if(!staging.map) {
+        con_printf("failed to map the staging buffer, falling back to glBufferSubData\n");
+        glDeleteBuffers(1, &staging.buffer);
+        staging.buffer = 0;
+        return;
+    }
+
+    staging.persistent = true;
+}
+
+static void staging_retire_oldest(GLuint64 timeout)
+{
+    struct staging_fence *f = &staging.fences[staging.first_fence];
+    GLenum status;
+
+    if(staging.num_fences == 0)
+        return;
+
+    do {
+        status = glClientWaitSync(f->sync, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+    } while(status == GL_TIMEOUT_EXPIRED && timeout != 0);
+
+    if(status == GL_TIMEOUT_EXPIRED)
+        return;
+
+    glDeleteSync(f->sync);
+    staging.retired = f->written;
+    staging.first_fence = (staging.first_fence + 1) % MAX_STAGING_FENCES;
+    staging.num_fences--;
+}
+
+static void staging_retire_signaled(void)
+{
+    while(staging.num_fences > 0) {
+        int n = staging.num_fences;
+        staging_retire_oldest(0);
+        if(n == staging.num_fences)
+            break;
+    }
+}
+
+static void staging_place_fence(void)
+{
+    struct staging_fence *f;
+
+    if(staging.written == staging.fenced)
+        return;
+
+    if(staging.num_fences == MAX_STAGING_FENCES)
+        staging_retire_oldest(1000000000);
+
+    f = &staging.fences[(staging.first_fence + staging.num_fences) % MAX_STAGING_FENCES];
+    f->sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    f->written = staging.written;
+    staging.num_fences++;
+    staging.fenced = staging.written;
+}
+
+// size must not be larger than GPU_HEAP_STAGING_SIZE
+static size_t staging_reserve(size_t size)
+{
+    size_t pos = staging.written % GPU_HEAP_STAGING_SIZE;
+    size_t waste = pos + size > GPU_HEAP_STAGING_SIZE ? GPU_HEAP_STAGING_SIZE - pos : 0;
+
+    staging_retire_signaled();
+
+    while(GPU_HEAP_STAGING_SIZE - (staging.written - staging.retired) < waste + size) {
+        /* the space is taken by copies of this frame, which aren't fenced yet */
+        if(staging.num_fences == 0)
+            staging_place_fence();
+
+        /* nothing in flight, so the whole ring is free. the wasted tail is skipped right away
+         * instead of being counted, waste + size can be more than the ring holds */
+        if(staging.num_fences == 0) {
+            staging.written += waste;
+            staging.retired = staging.fenced = staging.written;
+            waste = 0;
+            break;
+        }
+
+        staging_retire_oldest(1000000000);
+    }
+
+    /* allocations never wrap around */
+    staging.written += waste;
+    pos = staging.written % GPU_HEAP_STAGING_SIZE;
+    staging.written += size;
+
+    return pos;
+}
+
+void gpu_heap_end_frame(void)
+{
+    if(!staging.persistent)
+        return;
+
+    staging_retire_signaled();
+    staging_place_fence();
+}
+
+void gpu_heap_staging_shutdown(void)
+{
+    while(staging.num_fences > 0) {
+        glDeleteSync(staging.fences[staging.first_fence].sync);
+        staging.first_fence = (staging.first_fence + 1) % MAX_STAGING_FENCES;
+        staging.num_fences--;
+    }
+
+    if(staging.buffer) {
+        glBindBuffer(GL_COPY_READ_BUFFER, staging.buffer);
+        glUnmapBuffer(GL_COPY_READ_BUFFER);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glDeleteBuffers(1, &staging.buffer);
+    }
+
+    memset(&staging, 0, sizeof(staging));
+}
+
+bool gpu_heap_is_persistent(void)
+{
+    return staging.persistent;
+}
+
+static uint32_t create_buffer(size_t size)
+{
+    uint32_t buffer;
+
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    if(staging.persistent) {
+        /* only written by the gpu itself, so the driver can keep it in vram */
+        glBufferStorage(GL_COPY_WRITE_BUFFER, size, NULL, 0);
+    } else {
+        glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    return buffer;
+}
+
+static void insert_free_range(gpu_heap *heap, size_t index, size_t offset, size_t count)
+{
+    if(heap->num_free_ranges == heap->free_ranges_capacity) {
+        heap->free_ranges_capacity = heap->free_ranges_capacity ? heap->free_ranges_capacity * 2 : 64;
+        heap->free_ranges = realloc(heap->free_ranges, heap->free_ranges_capacity * sizeof(*heap->free_ranges));
+    }
+
+    memmove(&heap->free_ranges[index + 1], &heap->free_ranges[index],
+            (heap->num_free_ranges - index) * sizeof(*heap->free_ranges));
+    heap->free_ranges[index].offset = offset;
+    heap->free_ranges[index].count = count;
+    heap->num_free_ranges++;
+}
+
+static void remove_free_range(gpu_heap *heap, size_t index)
+{
+    memmove(&heap->free_ranges[index], &heap->free_ranges[index + 1],
+            (heap->num_free_ranges - index - 1) * sizeof(*heap->free_ranges));
+    heap->num_free_ranges--;
+}
+
+static size_t take_from_free_range(gpu_heap *heap, size_t index, size_t count)
+{
+    struct gpu_heap_range *r = &heap->free_ranges[index];
+    size_t offset = r->offset;
+
+    r->offset += count;
+    r->count -= count;
+    if(r->count == 0)
+        remove_free_range(heap, index);
+
+    heap->used += count;
+    return offset;
+}
+
+static void copy_within(gpu_heap *heap, uint32_t src, uint32_t dst, size_t src_offset, size_t dst_offset, size_t count)
+{
+    glBindBuffer(GL_COPY_READ_BUFFER, src);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, dst);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                        src_offset * heap->elem_size, dst_offset * heap->elem_size, count * heap->elem_size);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+static void grow(gpu_heap *heap, size_t min_capacity)
+{
+    size_t new_capacity = heap->capacity * 2;
+    uint32_t new_buffer;
+
+    if(new_capacity < min_capacity)
+        new_capacity = min_capacity;
+
+    /* keep everything at the same offset */
+    new_buffer = create_buffer(new_capacity * heap->elem_size);
+    copy_within(heap, heap->buffer, new_buffer, 0, 0, heap->capacity);
+    glDeleteBuffers(1, &heap->buffer);
+
+    gpu_heap_free(heap, heap->capacity, new_capacity - heap->capacity);
+    heap->used += new_capacity - heap->capacity; // gpu_heap_free subtracted it
+    heap->capacity = new_capacity;
+    heap->buffer = new_buffer;
+}
+
+void gpu_heap_init(gpu_heap *heap, size_t elem_size, size_t initial_capacity)
+{
+    if(!staging.init)
+        staging_init();
+
+    memset(heap, 0, sizeof(*heap));
+    heap->elem_size = elem_size;
+    heap->capacity = initial_capacity;
+    heap->buffer = create_buffer(initial_capacity * elem_size);
+
+    insert_free_range(heap, 0, 0, initial_capacity);
+}
+
+void gpu_heap_shutdown(gpu_heap *heap)
+{
+    glDeleteBuffers(1, &heap->buffer);
+    mem_free(heap->free_ranges);
+    memset(heap, 0, sizeof(*heap));
+}
+
+size_t gpu_heap_alloc(gpu_heap *heap, size_t count)
+{
+    if(count == 0)
+        return GPU_HEAP_INVALID;
+
+    /* first fit */
+    for(size_t i = 0; i < heap->num_free_ranges; i++) {
+        if(heap->free_ranges[i].count >= count)
+            return take_from_free_range(heap, i, count);
+    }
+
+    grow(heap, heap->capacity + count);
+    return gpu_heap_alloc(heap, count);
+}
+
+void gpu_heap_free(gpu_heap *heap, size_t offset, size_t count)
+{
+    size_t i = 0;
+    struct gpu_heap_range *prev, *next;
+
+    if(offset == GPU_HEAP_INVALID || count == 0)
+        return;
+
+    heap->used -= count;
+
+    while(i < heap->num_free_ranges && heap->free_ranges[i].offset < offset)
+        i++;
+
+    prev = i > 0 ? &heap->free_ranges[i - 1] : NULL;
+    next = i < heap->num_free_ranges ? &heap->free_ranges[i] : NULL;
+
+    if(prev && prev->offset + prev->count == offset) {
+        prev->count += count;
+        if(next && offset + count == next->offset) {
+            prev->count += next->count;
+            remove_free_range(heap, i);
+        }
+    } else if(next && offset + count == next->offset) {
+        next->offset = offset;
+        next->count += count;
+    } else {
+        insert_free_range(heap, i, offset, count);
+    }
+}
+
+void gpu_heap_upload(gpu_heap *heap, size_t offset, size_t count, const void *data)
+{
+    size_t dst, size;
+    const ubyte *src = data;
+
+    if(offset == GPU_HEAP_INVALID || count == 0)
+        return;
+
+    dst = offset * heap->elem_size;
+    size = count * heap->elem_size;
+
+    if(!staging.persistent) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, heap->buffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, dst, size, data);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return;
+    }
+
+    glBindBuffer(GL_COPY_READ_BUFFER, staging.buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, heap->buffer);
+
+    while(size > 0) {
+        size_t n = size < GPU_HEAP_STAGING_SIZE ? size : GPU_HEAP_STAGING_SIZE;
+        size_t pos = staging_reserve(n);
+
+        memcpy(staging.map + pos, src, n);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, pos, dst, n);
+
+        src += n;
+        dst += n;
+        size -= n;
+    }
+
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+size_t gpu_heap_relocate(gpu_heap *heap, size_t offset, size_t count)
+{
+    size_t new_offset;
+
+    if(offset == GPU_HEAP_INVALID || count == 0)
+        return offset;
+
+    for(size_t i = 0; i < heap->num_free_ranges && heap->free_ranges[i].offset < offset; i++) {
+        if(heap->free_ranges[i].count < count)
+            continue;
+
+        new_offset = take_from_free_range(heap, i, count);
+        copy_within(heap, heap->buffer, heap->buffer, offset, new_offset, count);
+        gpu_heap_free(heap, offset, count);
+        return new_offset;
+    }
+
+    return offset;
+}
+
+size_t gpu_heap_largest_free(const gpu_heap *heap)
+{
+    size_t largest = 0;
+
+    for(size_t i = 0; i < heap->num_free_ranges; i++) {
+        if(heap->free_ranges[i].count > largest)
+            largest = heap->free_ranges[i].count;
+    }
+
+    return largest;
+}
+
+float gpu_heap_fragmentation(const gpu_heap *heap)
+{
+    size_t free = heap->capacity - heap->used;
+
+    if(free == 0)
+        return 0.0f;
+
+    return 1.0f - (float) gpu_heap_largest_free(heap) / (float) free;
+}
@@ -0,0 +1,57 @@
+#ifndef B173C_GPU_HEAP_H
+#define B173C_GPU_HEAP_H
+
+#include "common.h"
+#include <stdint.h>
+
+#define GPU_HEAP_INVALID ((size_t) -1)
+
+/* size of the persistently mapped buffer that all uploads go through */
+#define GPU_HEAP_STAGING_SIZE (8 << 20)
+
+/* hands out ranges of fixed size elements from one big gl buffer, so that
+ * many meshes can live in the same buffer and be drawn by one call.
+ * offsets and counts are in elements, not bytes.
+ *
+ * with gl 4.4 the buffer has immutable storage and is only ever written by copying from
+ * a persistently mapped staging ring, older contexts fall back to glBufferSubData */
+typedef struct {
+    uint32_t buffer;
+    size_t elem_size;
+    size_t capacity;
+    size_t used;
+
+    /* sorted by offset, neighbours are always merged */
+    struct gpu_heap_range {
+        size_t offset, count;
+    } *free_ranges;
+    size_t num_free_ranges, free_ranges_capacity;
+} gpu_heap;
+
+void gpu_heap_init(gpu_heap *heap, size_t elem_size, size_t initial_capacity);
+void gpu_heap_shutdown(gpu_heap *heap);
+
+// grows the buffer if needed (heap->buffer may change), existing offsets stay valid
+size_t gpu_heap_alloc(gpu_heap *heap, size_t count);
+void gpu_heap_free(gpu_heap *heap, size_t offset, size_t count);
+
+void gpu_heap_upload(gpu_heap *heap, size_t offset, size_t count, const void *data);
+
+// moves an allocation into the lowest free range before it, returns the new offset
+// (or the old one if nothing was moved). used to compact the heap when there is nothing else to do
+size_t gpu_heap_relocate(gpu_heap *heap, size_t offset, size_t count);
+
+size_t gpu_heap_largest_free(const gpu_heap *heap);
+
+// 0 when all free space is in one range, close to 1 when it is scattered in small holes
+float gpu_heap_fragmentation(const gpu_heap *heap);
+
+// fences the uploads of this frame, call once per frame after the last upload
+void gpu_heap_end_frame(void);
+
+// frees the staging ring, call after all heaps are shut down
+void gpu_heap_staging_shutdown(void);
+
+bool gpu_heap_is_persistent(void);
+
+#endif
@@ -0,0 +1,463 @@
+#include "vid.h"
+#include "mathlib.h"
+#include "common.h"
+#include "glad/glad.h"
+#include "game/world.h"
+#include "hashmap.c/hashmap.h"
+#include "assets.h"
+#include "client/cvar.h"
+#include "meshbuilder.h"
+#include "gpu_heap.h"
+
+/*
+ * far terrain is drawn from a heightmap and the colour of the topmost block of every column.
+ * columns are grouped into tiles of LOD_TILE_SIZE x LOD_TILE_SIZE chunks, every tile is meshed
+ * with cells of 2 blocks up to a single cell for the whole tile, doubling with every doubling of
+ * the distance (2x, 4x, 8x ... r_lod_distance). the amount of vertices per ring of tiles stays about
+ * the same up to 32x r_lod_distance, past that a tile can't get any coarser and it grows linearly.
+ *
+ * summaries are kept when the server unloads a column, so the horizon stays filled, until the
+ * camera is LOD_DROP_DISTANCE x r_zfar away from them
+ */
+
+#define LOD_TILE_SIZE 4
+#define LOD_TILE_BLOCKS (LOD_TILE_SIZE * WORLD_CHUNK_SIZE)
+#define LOD_MAX_REMESHES 4
+#define LOD_SKIRT_DEPTH 8
+/* tiles this many times r_zfar away are forgotten, so memory doesn't grow with the distance travelled */
+#define LOD_DROP_DISTANCE 2.0f
+
+extern struct gl_state gl;
+extern mat4_t view_mat, proj_mat;
+
+struct lod_column {
+    int x, z;
+    /* 0 if there is no block at all, otherwise the y above the topmost block */
+    ubyte height[WORLD_CHUNK_SIZE][WORLD_CHUNK_SIZE]; // X Z
+    ubyte color[WORLD_CHUNK_SIZE][WORLD_CHUNK_SIZE][3];
+};
+
+struct lod_tile {
+    int x, z;
+    /* bumped when a column of the tile changes */
+    int version;
+
+    /* what the current mesh was built from */
+    int mesh_version;
+    int mesh_cell_size;
+    uint16_t mesh_detailed_mask;
+    size_t heap_offset, num_verts;
+};
+
+struct lod_vert {
+    vec3_t pos;
+    ubyte r, g, b;
+    ubyte face;
+};
+
+static struct hashmap *lod_columns, *lod_tiles;
+static gpu_heap lod_heap;
+static uint32_t gl_lod_vao;
+static GLint loc_view, loc_proj;
+
+/* average colour of every tile of the terrain texture */
+static ubyte texture_colors[256][3];
+
+/* arguments of glMultiDrawArrays */
+static struct {
+    GLint *first;
+    GLsizei *count;
+    size_t num, capacity;
+} draws;
+
+/* tiles found too far away while drawing, removed once the iteration is done */
+static struct {
+    int (*coords)[2];
+    size_t num, capacity;
+} dropped;
+
+static int coords_compare(const void *a, const void *b, void *udata attr(unused))
+{
+    const int *ca = a, *cb = b;
+    return ca[0] != cb[0] || ca[1] != cb[1];
+}
+
+static uint64_t coords_hash(const void *item, uint64_t seed0, uint64_t seed1)
+{
+    return hashmap_xxhash3(item, 2 * sizeof(int), seed0, seed1);
+}
+
+static void compute_texture_colors(void)
+{
+    asset_image *terrain = asset_get_image(ASSET_TEXTURE_TERRAIN);
+    int tile_w = terrain->width / 16, tile_h = terrain->height / 16;
+
+    for(int i = 0; i < 256; i++) {
+        unsigned sum[3] = {0}, n = 0;
+
+        for(int y = 0; y < tile_h; y++) {
+            for(int x = 0; x < tile_w; x++) {
+                int px = (i % 16) * tile_w + x, py = (i / 16) * tile_h + y;
+                ubyte *p = &terrain->data[(py * terrain->width + px) * 4];
+
+                /* skip the holes of cutout textures */
+                if(p[3] < 128)
+                    continue;
+
+                sum[0] += p[0], sum[1] += p[1], sum[2] += p[2];
+                n++;
+            }
+        }
+
+        for(int c = 0; c < 3 && n > 0; c++)
+            texture_colors[i][c] = sum[c] / n;
+    }
+}
+
+void lod_renderer_init(void)
+{
+    lod_columns = hashmap_new(sizeof(struct lod_column), 0, 0, 0, coords_hash, coords_compare, NULL, NULL);
+    lod_tiles = hashmap_new(sizeof(struct lod_tile), 0, 0, 0, coords_hash, coords_compare, NULL, NULL);
+
+    gpu_heap_init(&lod_heap, sizeof(struct lod_vert), 1 << 18);
+
+    glGenVertexArrays(1, &gl_lod_vao);
+    glBindVertexArray(gl_lod_vao);
+    glVertexAttribFormat(0, 3, GL_FLOAT, GL_FALSE, 0); // position
+    glVertexAttribFormat(1, 3, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(vec3_t)); // color
+    glVertexAttribIFormat(2, 1, GL_UNSIGNED_BYTE, sizeof(vec3_t) + 3); // face
+    glVertexAttribBinding(0, 0);
+    glVertexAttribBinding(1, 0);
+    glVertexAttribBinding(2, 0);
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);
+    glBindVertexArray(0);
+
+    loc_view = glGetUniformLocation(gl.shader_lod, "VIEW");
+    loc_proj = glGetUniformLocation(gl.shader_lod, "PROJECTION");
+
+    compute_texture_colors();
+}
+
+void lod_renderer_shutdown(void)
+{
+    hashmap_free(lod_columns);
+    hashmap_free(lod_tiles);
+    gpu_heap_shutdown(&lod_heap);
+    glDeleteVertexArrays(1, &gl_lod_vao);
+    mem_free(draws.first);
+    mem_free(draws.count);
+    mem_free(dropped.coords);
+}
+
+void lod_renderer_clear(void)
+{
+    size_t i = 0;
+    void *it;
+
+    while(hashmap_iter(lod_tiles, &i, &it)) {
+        struct lod_tile *tile = it;
+        gpu_heap_free(&lod_heap, tile->heap_offset, tile->num_verts);
+    }
+
+    hashmap_clear(lod_columns, false);
+    hashmap_clear(lod_tiles, false);
+}
+
+static int tile_coord(int chunk_coord)
+{
+    return chunk_coord >= 0 ? chunk_coord / LOD_TILE_SIZE : (chunk_coord + 1) / LOD_TILE_SIZE - 1;
+}
+
+void lod_renderer_update_column(world_chunk *chunk)
+{
+    struct lod_column column = {.x = chunk->x, .z = chunk->z};
+    struct lod_tile key = {.x = tile_coord(chunk->x), .z = tile_coord(chunk->z)};
+    struct lod_tile *tile;
+
+    for(int x = 0; x < WORLD_CHUNK_SIZE; x++) {
+        for(int z = 0; z < WORLD_CHUNK_SIZE; z++) {
+            for(int y = WORLD_CHUNK_HEIGHT - 1; y >= 0; y--) {
+                block_data b = chunk->data[IDX_FROM_COORDS(x, y, z)];
+                int tex;
+
+                if(b.id == BLOCK_AIR || block_get_render_type(b.id) == RENDER_NONE)
+                    continue;
+
+                tex = block_get_texture_index(b.id, BLOCK_FACE_Y_POS, b.metadata,
+                                              (chunk->x << 4) + x, y, (chunk->z << 4) + z);
+                column.height[x][z] = y + 1;
+                memcpy(column.color[x][z], texture_colors[tex & 255], 3);
+                break;
+            }
+        }
+    }
+
+    hashmap_set(lod_columns, &column);
+
+    tile = (struct lod_tile *) hashmap_get(lod_tiles, &key);
+    if(tile == NULL) {
+        key.heap_offset = GPU_HEAP_INVALID;
+        key.mesh_version = -1;
+        hashmap_set(lod_tiles, &key);
+        tile = (struct lod_tile *) hashmap_get(lod_tiles, &key);
+    }
+    tile->version++;
+}
+
+static struct lod_column *get_column(int x, int z)
+{
+    struct lod_column key = {.x = x, .z = z};
+    return (struct lod_column *) hashmap_get(lod_columns, &key);
+}
+
+static bool is_column_detailed(int x, int z)
+{
+    world_chunk *chunk = world_get_chunk(x, z);
+    return chunk != NULL && chunk->gl.detailed;
+}
+
+/* height and colour of a cell in tile local block coordinates, height 0 if there is nothing to draw.
+ * cells of 16 blocks and more cover whole columns, any detailed column in them leaves the cell out */
+static int get_cell(struct lod_column *columns[LOD_TILE_SIZE][LOD_TILE_SIZE], uint16_t detailed_mask,
+                    int bx, int bz, int cell_size, ubyte color[3])
+{
+    int span = max(1, cell_size / WORLD_CHUNK_SIZE);
+    unsigned sum[3] = {0}, n = 0;
+    int height = 0;
+
+    if(bx < 0 || bz < 0 || bx >= LOD_TILE_BLOCKS || bz >= LOD_TILE_BLOCKS)
+        return 0;
+
+    for(int cx = bx / WORLD_CHUNK_SIZE; cx < bx / WORLD_CHUNK_SIZE + span; cx++) {
+        for(int cz = bz / WORLD_CHUNK_SIZE; cz < bz / WORLD_CHUNK_SIZE + span; cz++) {
+            if(detailed_mask & (1 << (cx * LOD_TILE_SIZE + cz)))
+                return 0;
+        }
+    }
+
+    for(int x = bx; x < bx + cell_size; x++) {
+        for(int z = bz; z < bz + cell_size; z++) {
+            struct lod_column *column = columns[x / WORLD_CHUNK_SIZE][z / WORLD_CHUNK_SIZE];
+            int cx = x % WORLD_CHUNK_SIZE, cz = z % WORLD_CHUNK_SIZE;
+
+            if(column == NULL || column->height[cx][cz] == 0)
+                continue;
+            height = max(height, column->height[cx][cz]);
+            for(int c = 0; c < 3; c++)
+                sum[c] += column->color[cx][cz][c];
+            n++;
+        }
+    }
+
+    for(int c = 0; c < 3 && n > 0; c++)
+        color[c] = sum[c] / n;
+
+    return height;
+}
+
+static void add_quad(vec3_t a, vec3_t b, vec3_t c, vec3_t d, const ubyte color[3], block_face face)
+{
+    struct lod_vert v[4];
+    vec3_t pos[4] = {a, b, c, d};
+
+    for(int i = 0; i < 4; i++) {
+        v[i].pos = pos[i];
+        v[i].r = color[0], v[i].g = color[1], v[i].b = color[2];
+        v[i].face = face;
+    }
+
+    meshbuilder_add_quad(&v[0], &v[1], &v[2], &v[3]);
+}
+
+static void remesh_tile(struct lod_tile *tile, int cell_size, uint16_t detailed_mask)
+{
+    struct lod_column *columns[LOD_TILE_SIZE][LOD_TILE_SIZE];
+    int ox = tile->x * LOD_TILE_BLOCKS, oz = tile->z * LOD_TILE_BLOCKS;
+    struct lod_vert *verts;
+    size_t num_verts;
+
+    for(int x = 0; x < LOD_TILE_SIZE; x++) {
+        for(int z = 0; z < LOD_TILE_SIZE; z++)
+            columns[x][z] = get_column(tile->x * LOD_TILE_SIZE + x, tile->z * LOD_TILE_SIZE + z);
+    }
+
+    meshbuilder_start(sizeof(struct lod_vert));
+
+    for(int bx = 0; bx < LOD_TILE_BLOCKS; bx += cell_size) {
+        for(int bz = 0; bz < LOD_TILE_BLOCKS; bz += cell_size) {
+            static const int dirs[4][2] = {{0, -1}, {0, 1}, {-1, 0}, {1, 0}};
+            static const block_face faces[4] = {BLOCK_FACE_Z_NEG, BLOCK_FACE_Z_POS, BLOCK_FACE_X_NEG, BLOCK_FACE_X_POS};
+            ubyte color[3], unused[3];
+            float x0 = ox + bx, z0 = oz + bz, x1 = x0 + cell_size, z1 = z0 + cell_size;
+            int h = get_cell(columns, detailed_mask, bx, bz, cell_size, color);
+
+            if(h == 0)
+                continue;
+
+            add_quad(vec3(x0, h, z0), vec3(x1, h, z0), vec3(x0, h, z1), vec3(x1, h, z1), color, BLOCK_FACE_Y_POS);
+
+            /* walls down to the neighbouring cell. where there is no neighbouring lod cell (another
+             * tile, a detailed chunk or a different cell size) a skirt hides the crack instead */
+            for(int d = 0; d < 4; d++) {
+                int nh = get_cell(columns, detailed_mask, bx + dirs[d][0] * cell_size, bz + dirs[d][1] * cell_size,
+                                  cell_size, unused);
+                float y0, y1 = h;
+
+                if(nh == 0)
+                    nh = max(0, h - LOD_SKIRT_DEPTH);
+                if(nh >= h)
+                    continue;
+                y0 = nh;
+
+                switch(faces[d]) {
+                case BLOCK_FACE_Z_NEG:
+                    add_quad(vec3(x1, y1, z0), vec3(x0, y1, z0), vec3(x1, y0, z0), vec3(x0, y0, z0), color, faces[d]);
+                    break;
+                case BLOCK_FACE_Z_POS:
+                    add_quad(vec3(x0, y1, z1), vec3(x1, y1, z1), vec3(x0, y0, z1), vec3(x1, y0, z1), color, faces[d]);
+                    break;
+                case BLOCK_FACE_X_NEG:
+                    add_quad(vec3(x0, y1, z0), vec3(x0, y1, z1), vec3(x0, y0, z0), vec3(x0, y0, z1), color, faces[d]);
+                    break;
+                default:
+                    add_quad(vec3(x1, y1, z1), vec3(x1, y1, z0), vec3(x1, y0, z1), vec3(x1, y0, z0), color, faces[d]);
+                    break;
+                }
+            }
+        }
+    }
+
+    meshbuilder_finish((void **) &verts, &num_verts, NULL, NULL, NULL);
+
+    gpu_heap_free(&lod_heap, tile->heap_offset, tile->num_verts);
+    tile->heap_offset = gpu_heap_alloc(&lod_heap, num_verts);
+    tile->num_verts = num_verts;
+    gpu_heap_upload(&lod_heap, tile->heap_offset, num_verts, verts);
+    mem_free(verts);
+
+    tile->mesh_version = tile->version;
+    tile->mesh_cell_size = cell_size;
+    tile->mesh_detailed_mask = detailed_mask;
+}
+
+static void drop_tile(int tile_x, int tile_z)
+{
+    struct lod_tile key = {.x = tile_x, .z = tile_z}, *tile = (struct lod_tile *) hashmap_get(lod_tiles, &key);
+
+    if(tile == NULL)
+        return;
+
+    gpu_heap_free(&lod_heap, tile->heap_offset, tile->num_verts);
+    hashmap_delete(lod_tiles, &key);
+
+    for(int x = 0; x < LOD_TILE_SIZE; x++) {
+        for(int z = 0; z < LOD_TILE_SIZE; z++) {
+            struct lod_column column = {.x = tile_x * LOD_TILE_SIZE + x, .z = tile_z * LOD_TILE_SIZE + z};
+            hashmap_delete(lod_columns, &column);
+        }
+    }
+}
+
+static uint16_t get_detailed_mask(struct lod_tile *tile, float dist_chunks)
+{
+    uint16_t mask = 0;
+
+    /* no chunk of the tile can be close enough to be drawn in detail */
+    if(dist_chunks - LOD_TILE_SIZE > r_lod_distance.value)
+        return 0;
+
+    for(int x = 0; x < LOD_TILE_SIZE; x++) {
+        for(int z = 0; z < LOD_TILE_SIZE; z++) {
+            if(is_column_detailed(tile->x * LOD_TILE_SIZE + x, tile->z * LOD_TILE_SIZE + z))
+                mask |= 1 << (x * LOD_TILE_SIZE + z);
+        }
+    }
+
+    return mask;
+}
+
+void lod_renderer_render(vec3_t cam_pos)
+{
+    size_t i = 0;
+    void *it;
+    int num_remeshed = 0;
+
+    if(!r_lod.integer || hashmap_count(lod_tiles) == 0)
+        return;
+
+    if(draws.capacity < hashmap_count(lod_tiles)) {
+        draws.capacity = hashmap_count(lod_tiles) * 2;
+        draws.first = realloc(draws.first, draws.capacity * sizeof(*draws.first));
+        draws.count = realloc(draws.count, draws.capacity * sizeof(*draws.count));
+    }
+
+    draws.num = 0;
+    dropped.num = 0;
+    while(hashmap_iter(lod_tiles, &i, &it)) {
+        struct lod_tile *tile = it;
+        float dx = (tile->x + 0.5f) * LOD_TILE_BLOCKS - cam_pos.x;
+        float dz = (tile->z + 0.5f) * LOD_TILE_BLOCKS - cam_pos.z;
+        float dist = sqrtf(dx * dx + dz * dz) / WORLD_CHUNK_SIZE;
+        float lod_dist = max(r_lod_distance.value, 1.0f);
+        int cell_size = 2;
+        uint16_t detailed_mask;
+        bbox_t bounds = {
+                .mins = vec3(tile->x * LOD_TILE_BLOCKS, 0, tile->z * LOD_TILE_BLOCKS),
+                .maxs = vec3((tile->x + 1) * LOD_TILE_BLOCKS, WORLD_CHUNK_HEIGHT, (tile->z + 1) * LOD_TILE_BLOCKS)
+        };
+
+        if(dist * WORLD_CHUNK_SIZE > r_zfar.value * LOD_DROP_DISTANCE + LOD_TILE_BLOCKS) {
+            if(dropped.num == dropped.capacity) {
+                dropped.capacity = dropped.capacity ? dropped.capacity * 2 : 64;
+                dropped.coords = realloc(dropped.coords, dropped.capacity * sizeof(*dropped.coords));
+            }
+            dropped.coords[dropped.num][0] = tile->x;
+            dropped.coords[dropped.num][1] = tile->z;
+            dropped.num++;
+            continue;
+        }
+
+        /* tiles outside of the view (which ends at r_zfar) are neither meshed nor drawn */
+        if(!world_renderer_bbox_on_frustum(bounds))
+            continue;
+
+        detailed_mask = get_detailed_mask(tile, dist);
+
+        /* the cell size doubles with every doubling of the distance, up to one cell per tile */
+        for(float octave = lod_dist * 2; dist >= octave && cell_size < LOD_TILE_BLOCKS; octave *= 2)
+            cell_size *= 2;
+
+        if(tile->mesh_version != tile->version || tile->mesh_cell_size != cell_size ||
+           tile->mesh_detailed_mask != detailed_mask) {
+            /* tiles without a mesh are always built, the others can wait a few frames */
+            if(tile->mesh_version == -1 || num_remeshed < LOD_MAX_REMESHES) {
+                remesh_tile(tile, cell_size, detailed_mask);
+                num_remeshed++;
+            }
+        }
+
+        if(tile->num_verts == 0)
+            continue;
+
+        draws.first[draws.num] = tile->heap_offset;
+        draws.count[draws.num] = tile->num_verts;
+        draws.num++;
+    }
+
+    for(size_t d = 0; d < dropped.num; d++)
+        drop_tile(dropped.coords[d][0], dropped.coords[d][1]);
+
+    if(draws.num == 0)
+        return;
+
+    glUseProgram(gl.shader_lod);
+    glUniformMatrix4fv(loc_view, 1, GL_FALSE, (const GLfloat *) view_mat);
+    glUniformMatrix4fv(loc_proj, 1, GL_FALSE, (const GLfloat *) proj_mat);
+
+    glBindVertexArray(gl_lod_vao);
+    glBindVertexBuffer(0, lod_heap.buffer, 0, sizeof(struct lod_vert));
+    glMultiDrawArrays(GL_TRIANGLES, draws.first, draws.count, draws.num);
+    glBindVertexArray(0);
+}
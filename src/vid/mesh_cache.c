@@ -0,0 +1,347 @@
+#include "mesh_cache.h"
+#include "client/cvar.h"
+#include "hashmap.c/hashmap.h"
+#include <SDL2/SDL.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#define MESH_CACHE_MAGIC 0x48534d42 // "BMSH"
+
+/* meshes waiting for the writer thread. when it falls this far behind further stores are
+ * dropped, the column just gets meshed again next time */
+#define MESH_CACHE_QUEUE 64
+
+struct mesh_cache_header {
+    uint32_t magic;
+    uint32_t format;
+    uint32_t vert_size;
+    uint32_t num_verts;
+    uint64_t key;
+    uint32_t pass_count[RENDER_PASS_COUNT][WORLD_CHUNK_SECTIONS];
+};
+
+/* everything besides the blocks that changes what the mesher puts out */
+static uint64_t version_seed(void)
+{
+    uint32_t v[] = {
+            MESH_CACHE_FORMAT, sizeof(struct vert_complex),
+            r_fancyleaves.integer, r_smartleaves.integer, r_redstone_dot.integer
+    };
+    return hashmap_xxhash3(v, sizeof(v), 0, 0);
+}
+
+/* the light is sampled from its own texture and not part of the mesh, so only the ids and
+ * metadata go into the key */
+static uint16_t shape_of(block_data b)
+{
+    return b.id | b.metadata << 8;
+}
+
+uint64_t mesh_cache_key(world_chunk *chunk)
+{
+    /* the faces along the edges and the fluid heights look one block into the neighbours,
+     * so the ring of blocks around the column is part of the key too */
+    static uint16_t column[WORLD_CHUNK_SIZE * WORLD_CHUNK_SIZE * WORLD_CHUNK_HEIGHT];
+    static uint16_t ring[4 * WORLD_CHUNK_SIZE + 4][WORLD_CHUNK_HEIGHT];
+    world_chunk *neighbours[3][3];
+    uint64_t seed = version_seed();
+    int n = 0;
+
+    for(int dx = -1; dx <= 1; dx++) {
+        for(int dz = -1; dz <= 1; dz++)
+            neighbours[dx + 1][dz + 1] = world_get_chunk(chunk->x + dx, chunk->z + dz);
+    }
+
+    memset(ring, 0, sizeof(ring));
+    for(int x = -1; x <= WORLD_CHUNK_SIZE; x++) {
+        for(int z = -1; z <= WORLD_CHUNK_SIZE; z++) {
+            int cx = x < 0 ? 0 : x < WORLD_CHUNK_SIZE ? 1 : 2;
+            int cz = z < 0 ? 0 : z < WORLD_CHUNK_SIZE ? 1 : 2;
+            world_chunk *c = neighbours[cx][cz];
+
+            if(cx == 1 && cz == 1)
+                continue;
+
+            if(c != NULL) {
+                for(int y = 0; y < WORLD_CHUNK_HEIGHT; y++)
+                    ring[n][y] = shape_of(c->data[IDX_FROM_COORDS(x, y, z)]);
+            }
+            n++;
+        }
+    }
+
+    for(size_t i = 0; i < sizeof(column) / sizeof(column[0]); i++)
+        column[i] = shape_of(chunk->data[i]);
+
+    seed = hashmap_xxhash3(column, sizeof(column), seed, 0);
+    seed = hashmap_xxhash3(&chunk->gl.detail_sections, sizeof(chunk->gl.detail_sections), seed, 0);
+    return hashmap_xxhash3(ring, sizeof(ring), seed, 0);
+}
+
+static void get_path(char *path, size_t size, uint64_t key)
+{
+    snprintf(path, size, MESH_CACHE_DIR "/%016" PRIx64 ".mesh", key);
+}
+
+bool mesh_cache_load(world_chunk *chunk, uint64_t key)
+{
+    struct mesh_cache_header header;
+    char path[64];
+    FILE *f;
+
+    get_path(path, sizeof(path), key);
+    f = fopen(path, "rb");
+    if(!f)
+        return false;
+
+    if(fread(&header, sizeof(header), 1, f) != 1 || header.magic != MESH_CACHE_MAGIC ||
+       header.format != MESH_CACHE_FORMAT || header.vert_size != sizeof(struct vert_complex) || header.key != key) {
+        fclose(f);
+        return false;
+    }
+
+    chunk->gl.verts_complex = NULL;
+    if(header.num_verts > 0) {
+        chunk->gl.verts_complex = mem_alloc(header.num_verts * sizeof(struct vert_complex));
+        if(fread(chunk->gl.verts_complex, sizeof(struct vert_complex), header.num_verts, f) != header.num_verts) {
+            mem_free(chunk->gl.verts_complex);
+            fclose(f);
+            return false;
+        }
+    }
+
+    fclose(f);
+
+    chunk->gl.n_verts_complex = header.num_verts;
+    for(int pass = 0; pass < RENDER_PASS_COUNT; pass++) {
+        for(int section = 0; section < WORLD_CHUNK_SECTIONS; section++)
+            chunk->gl.pass_count[pass][section] = header.pass_count[pass][section];
+    }
+
+    return true;
+}
+
+struct store_job {
+    struct mesh_cache_header header;
+    struct vert_complex *verts;
+};
+
+/* files are written by a thread of their own so that a miss never waits on the disk. it is
+ * started by the first store, and prunes the directory down to r_mesh_cache_mb before anything else */
+static struct {
+    SDL_Thread *thread;
+    SDL_mutex *lock;
+    SDL_cond *wake;
+    bool quit, failed;
+    size_t write_errors; // the console is not thread safe, the main thread reports these
+
+    struct store_job jobs[MESH_CACHE_QUEUE];
+    size_t head, tail; // ring positions, empty when equal
+    size_t budget; // bytes, 0 for no limit
+} writer;
+
+// false if the mesh could not be written
+static bool write_entry(const struct store_job *job)
+{
+    char path[64], tmp_path[68];
+    FILE *f;
+    bool ok;
+
+    get_path(path, sizeof(path), job->header.key);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    f = fopen(tmp_path, "wb");
+    if(!f) {
+        /* first store, or the directory was deleted */
+        sys_mkdir(MESH_CACHE_DIR);
+        f = fopen(tmp_path, "wb");
+        if(!f)
+            return false;
+    }
+
+    ok = fwrite(&job->header, sizeof(job->header), 1, f) == 1;
+    if(job->header.num_verts > 0)
+        ok = ok && fwrite(job->verts, sizeof(struct vert_complex), job->header.num_verts, f) == job->header.num_verts;
+    ok = fclose(f) == 0 && ok;
+
+    /* written under another name first, so that a crash never leaves a truncated mesh behind */
+    remove(path);
+    if(!ok || rename(tmp_path, path) != 0) {
+        remove(tmp_path);
+        return false;
+    }
+    return true;
+}
+
+struct cache_file {
+    char name[32];
+    time_t mtime;
+    size_t size;
+};
+
+static int cache_file_compare(const void *a, const void *b)
+{
+    const struct cache_file *fa = a, *fb = b;
+    return (fa->mtime > fb->mtime) - (fa->mtime < fb->mtime);
+}
+
+/* deletes the meshes that were written longest ago until the rest fits into the budget */
+static void prune(size_t budget)
+{
+    struct cache_file *files = NULL;
+    size_t num_files = 0, capacity = 0, total = 0;
+    struct dirent *entry;
+    DIR *dir;
+
+    if(budget == 0 || (dir = opendir(MESH_CACHE_DIR)) == NULL)
+        return;
+
+    while((entry = readdir(dir)) != NULL) {
+        struct stat st;
+        char path[64];
+        size_t len = strlen(entry->d_name);
+
+        if(len < 5 || len >= sizeof(files->name) || strcmp(entry->d_name + len - 5, ".mesh") != 0)
+            continue;
+        snprintf(path, sizeof(path), MESH_CACHE_DIR "/%s", entry->d_name);
+        if(stat(path, &st) != 0)
+            continue;
+
+        if(num_files == capacity) {
+            capacity = capacity ? capacity * 2 : 256;
+            files = realloc(files, capacity * sizeof(*files));
+        }
+        strlcpy(files[num_files].name, entry->d_name, sizeof(files->name));
+        files[num_files].mtime = st.st_mtime;
+        files[num_files].size = st.st_size;
+        total += st.st_size;
+        num_files++;
+    }
+    closedir(dir);
+
+    if(total > budget) {
+        qsort(files, num_files, sizeof(*files), cache_file_compare);
+        for(size_t i = 0; i < num_files && total > budget; i++) {
+            char path[64];
+
+            snprintf(path, sizeof(path), MESH_CACHE_DIR "/%s", files[i].name);
+            if(remove(path) == 0)
+                total -= files[i].size;
+        }
+    }
+
+    free(files);
+}
+
+static int writer_thread(void *data attr(unused))
+{
+    prune(writer.budget);
+
+    SDL_LockMutex(writer.lock);
+    while(true) {
+        struct store_job job;
+        bool ok;
+
+        while(!writer.quit && writer.head == writer.tail)
+            SDL_CondWait(writer.wake, writer.lock);
+        if(writer.head == writer.tail)
+            break;
+
+        job = writer.jobs[writer.tail];
+        writer.tail = (writer.tail + 1) % MESH_CACHE_QUEUE;
+        SDL_UnlockMutex(writer.lock);
+
+        ok = write_entry(&job);
+        mem_free(job.verts);
+
+        SDL_LockMutex(writer.lock);
+        if(!ok)
+            writer.write_errors++;
+    }
+    SDL_UnlockMutex(writer.lock);
+    return 0;
+}
+
+static bool writer_start(void)
+{
+    if(writer.thread || writer.failed)
+        return writer.thread != NULL;
+
+    writer.budget = (size_t) max(r_mesh_cache_mb.integer, 0) * 1024 * 1024;
+    writer.lock = SDL_CreateMutex();
+    writer.wake = SDL_CreateCond();
+    if(writer.lock && writer.wake)
+        writer.thread = SDL_CreateThread(writer_thread, "meshcache", NULL);
+
+    if(!writer.thread) {
+        con_printf("mesh cache: no writer thread (%s), meshes are not stored\n", SDL_GetError());
+        writer.failed = true;
+    }
+    return writer.thread != NULL;
+}
+
+void mesh_cache_store(const world_chunk *chunk, uint64_t key)
+{
+    struct store_job job = {
+            .header = {
+                    .magic = MESH_CACHE_MAGIC,
+                    .format = MESH_CACHE_FORMAT,
+                    .vert_size = sizeof(struct vert_complex),
+                    .num_verts = chunk->gl.n_verts_complex,
+                    .key = key
+            }
+    };
+    size_t write_errors;
+    bool full;
+
+    if(!writer_start())
+        return;
+
+    SDL_LockMutex(writer.lock);
+    write_errors = writer.write_errors;
+    writer.write_errors = 0;
+    full = (writer.head + 1) % MESH_CACHE_QUEUE == writer.tail;
+    SDL_UnlockMutex(writer.lock);
+
+    if(write_errors > 0)
+        con_printf("mesh cache: failed to write %zu meshes to '" MESH_CACHE_DIR "'\n", write_errors);
+    if(full)
+        return;
+
+    for(int pass = 0; pass < RENDER_PASS_COUNT; pass++) {
+        for(int section = 0; section < WORLD_CHUNK_SECTIONS; section++)
+            job.header.pass_count[pass][section] = chunk->gl.pass_count[pass][section];
+    }
+
+    /* the chunk's vertices get replaced on its next remesh, the writer gets a copy */
+    if(job.header.num_verts > 0) {
+        job.verts = mem_alloc(job.header.num_verts * sizeof(struct vert_complex));
+        memcpy(job.verts, chunk->gl.verts_complex, job.header.num_verts * sizeof(struct vert_complex));
+    }
+
+    /* only this thread adds jobs, so the space checked above is still there */
+    SDL_LockMutex(writer.lock);
+    writer.jobs[writer.head] = job;
+    writer.head = (writer.head + 1) % MESH_CACHE_QUEUE;
+    SDL_CondSignal(writer.wake);
+    SDL_UnlockMutex(writer.lock);
+}
+
+void mesh_cache_shutdown(void)
+{
+    if(!writer.thread)
+        return;
+
+    /* whatever is still queued gets written first */
+    SDL_LockMutex(writer.lock);
+    writer.quit = true;
+    SDL_CondSignal(writer.wake);
+    SDL_UnlockMutex(writer.lock);
+
+    SDL_WaitThread(writer.thread, NULL);
+    SDL_DestroyCond(writer.wake);
+    SDL_DestroyMutex(writer.lock);
+    memset(&writer, 0, sizeof(writer));
+}
@@ -0,0 +1,28 @@
+#ifndef B173C_MESH_CACHE_H
+#define B173C_MESH_CACHE_H
+
+#include "common.h"
+#include "game/world.h"
+#include <stdint.h>
+
+/* finished complex meshes are kept on disk, named after a hash of everything the mesher reads:
+ * the blocks of the column (not their light), the ring of blocks around it, the mesh format and the
+ * render cvars. a column that hashes the same as before gets its old mesh back without meshing.
+ * only used while r_mesh_cache is on. files are written in the background, and the oldest ones are
+ * deleted when the directory is over r_mesh_cache_mb */
+
+#define MESH_CACHE_DIR "meshcache"
+
+// bump when the output of the mesher changes
+#define MESH_CACHE_FORMAT 3
+
+uint64_t mesh_cache_key(world_chunk *chunk);
+
+// fills verts_complex, n_verts_complex and pass_count, false on a miss
+bool mesh_cache_load(world_chunk *chunk, uint64_t key);
+// queues the mesh of the chunk for writing
+void mesh_cache_store(const world_chunk *chunk, uint64_t key);
+// waits for the queued meshes to be written
+void mesh_cache_shutdown(void);
+
+#endif
@@ -9,18 +9,24 @@
 
 #define DEFAULT_CAPACITY 1024
 
-static struct {
-    size_t count;
-    size_t capacity;
-    size_t elem_size;
-    void *data;
-} vertices;
-
-static struct {
-    size_t count;
-    size_t capacity;
-    MESHBUILDER_INDEX_TYPE *data;
-} indices;
+/* every bucket is built separately and they are laid out one after another by meshbuilder_finish,
+ * so that the caller can draw each bucket with its own state (e.g. opaque and translucent geometry) */
+static struct bucket {
+    struct {
+        size_t count;
+        size_t capacity;
+        void *data;
+    } vertices;
+
+    struct {
+        size_t count;
+        size_t capacity;
+        MESHBUILDER_INDEX_TYPE *data;
+    } indices;
+} buckets[MESHBUILDER_MAX_BUCKETS];
+
+static size_t elem_size;
+static struct bucket *cur_bucket = &buckets[0];
 
 struct meshbuilder_pair {
     void *vertex;
@@ -33,25 +39,20 @@ static bool hashmap_init = false;
 int cmpfunc(const void *v1, const void *v2, void *_ attr(unused))
 {
     const struct meshbuilder_pair *p1 = v1, *p2 = v2;
-    return memcmp(p1->vertex, p2->vertex, vertices.elem_size);
+    return memcmp(p1->vertex, p2->vertex, elem_size);
 }
 
 uint64_t hashfunc(const void *v, uint64_t seed0, uint64_t seed1)
 {
     const struct meshbuilder_pair *p = v;
-    return hashmap_xxhash3(p->vertex, vertices.elem_size, seed0, seed1);
+    return hashmap_xxhash3(p->vertex, elem_size, seed0, seed1);
 }
 
 void meshbuilder_start(size_t vtx_size)
 {
-    vertices.elem_size = vtx_size;
-    vertices.count = 0;
-    vertices.capacity = DEFAULT_CAPACITY;
-    vertices.data = mem_alloc(vertices.capacity * vertices.elem_size);
-
-    indices.count = 0;
-    indices.capacity = DEFAULT_CAPACITY;
-    indices.data = mem_alloc(indices.capacity * sizeof(MESHBUILDER_INDEX_TYPE));
+    elem_size = vtx_size;
+    memset(buckets, 0, sizeof(buckets));
+    cur_bucket = &buckets[0];
 
     if(!hashmap_init) {
         vtx_2_idx_map = hashmap_new(sizeof(struct meshbuilder_pair), 0, 0, 0, hashfunc, cmpfunc, NULL, NULL);
@@ -59,40 +60,78 @@ void meshbuilder_start(size_t vtx_size)
     }
 }
 
-void meshbuilder_finish(void **verts_dest, size_t *num_verts_dest, MESHBUILDER_INDEX_TYPE **indices_dest, size_t *num_indices_dest)
+void meshbuilder_set_bucket(size_t bucket)
 {
-    if(vertices.count > 0)
-        *verts_dest = realloc(vertices.data, vertices.count * vertices.elem_size);
-    else
-        *verts_dest = NULL;
-    *num_verts_dest = vertices.count;
-
-    if(indices_dest) {
-        if(indices.count > 0) {
-            *indices_dest = realloc(indices.data, indices.count * sizeof(MESHBUILDER_INDEX_TYPE));
-        } else {
-            *indices_dest = NULL;
-        }
+    if(bucket >= MESHBUILDER_MAX_BUCKETS)
+        bucket = MESHBUILDER_MAX_BUCKETS - 1;
+    cur_bucket = &buckets[bucket];
+}
+
+void meshbuilder_finish(void **verts_dest, size_t *num_verts_dest, MESHBUILDER_INDEX_TYPE **indices_dest,
+                        size_t *num_indices_dest, size_t *bucket_sizes_dest)
+{
+    size_t num_verts = 0, num_indices = 0;
+    byte *verts = NULL;
+    MESHBUILDER_INDEX_TYPE *idx = NULL;
+
+    for(size_t b = 0; b < MESHBUILDER_MAX_BUCKETS; b++) {
+        num_verts += buckets[b].vertices.count;
+        num_indices += buckets[b].indices.count;
     }
-    if(num_indices_dest) {
-        *num_indices_dest = indices.count;
+
+    if(num_verts > 0)
+        verts = mem_alloc(num_verts * elem_size);
+    if(indices_dest && num_indices > 0)
+        idx = mem_alloc(num_indices * sizeof(MESHBUILDER_INDEX_TYPE));
+
+    num_verts = 0;
+    num_indices = 0;
+    for(size_t b = 0; b < MESHBUILDER_MAX_BUCKETS; b++) {
+        struct bucket *bucket = &buckets[b];
+
+        if(bucket->vertices.count > 0)
+            memcpy(verts + num_verts * elem_size, bucket->vertices.data, bucket->vertices.count * elem_size);
+
+        /* indices are local to their bucket, move them to where the bucket ends up */
+        if(idx) {
+            for(size_t i = 0; i < bucket->indices.count; i++)
+                idx[num_indices + i] = (MESHBUILDER_INDEX_TYPE) (bucket->indices.data[i] + num_verts);
+        }
+
+        if(bucket_sizes_dest)
+            bucket_sizes_dest[b] = bucket->vertices.count;
+
+        num_verts += bucket->vertices.count;
+        num_indices += bucket->indices.count;
+
+        mem_free(bucket->vertices.data);
+        mem_free(bucket->indices.data);
     }
 
-    memset(&vertices, 0, sizeof(vertices));
-    memset(&indices, 0, sizeof(indices));
+    *verts_dest = verts;
+    *num_verts_dest = num_verts;
+
+    if(indices_dest)
+        *indices_dest = idx;
+    if(num_indices_dest)
+        *num_indices_dest = num_indices;
+
+    memset(buckets, 0, sizeof(buckets));
+    cur_bucket = &buckets[0];
 
     hashmap_clear(vtx_2_idx_map, false);
 }
 
 void meshbuilder_add_index(MESHBUILDER_INDEX_TYPE idx)
 {
-    indices.data[indices.count] = idx;
-    indices.count++;
-
-    if(indices.count >= indices.capacity) {
-        indices.capacity += DEFAULT_CAPACITY;
-        indices.data = realloc(indices.data, indices.capacity * sizeof(MESHBUILDER_INDEX_TYPE));
+    if(cur_bucket->indices.count >= cur_bucket->indices.capacity) {
+        cur_bucket->indices.capacity += DEFAULT_CAPACITY;
+        cur_bucket->indices.data = realloc(cur_bucket->indices.data,
+                                           cur_bucket->indices.capacity * sizeof(MESHBUILDER_INDEX_TYPE));
     }
+
+    cur_bucket->indices.data[cur_bucket->indices.count] = idx;
+    cur_bucket->indices.count++;
 }
 
 void meshbuilder_add_vert(void *v)
@@ -106,14 +145,14 @@ void meshbuilder_add_vert(void *v)
         return;
     }*/
 
-    memcpy((byte *) vertices.data + vertices.count * vertices.elem_size, v, vertices.elem_size);
-    meshbuilder_add_index(vertices.count);
-    vertices.count++;
-
-    if(vertices.count >= vertices.capacity) {
-        vertices.capacity += DEFAULT_CAPACITY;
-        vertices.data = realloc(vertices.data, vertices.capacity * vertices.elem_size);
+    if(cur_bucket->vertices.count >= cur_bucket->vertices.capacity) {
+        cur_bucket->vertices.capacity += DEFAULT_CAPACITY;
+        cur_bucket->vertices.data = realloc(cur_bucket->vertices.data, cur_bucket->vertices.capacity * elem_size);
     }
+
+    memcpy((byte *) cur_bucket->vertices.data + cur_bucket->vertices.count * elem_size, v, elem_size);
+    meshbuilder_add_index(cur_bucket->vertices.count);
+    cur_bucket->vertices.count++;
 }
 
 void meshbuilder_add_quad(void *tl, void *tr, void *bl, void *br)
@@ -126,3 +165,20 @@ void meshbuilder_add_quad(void *tl, void *tr, void *bl, void *br)
     meshbuilder_add_vert(br);
     meshbuilder_add_vert(tr);
 }
+
+void *meshbuilder_add_verts(size_t count)
+{
+    byte *dest;
+
+    while(cur_bucket->vertices.count + count > cur_bucket->vertices.capacity) {
+        cur_bucket->vertices.capacity += DEFAULT_CAPACITY;
+        cur_bucket->vertices.data = realloc(cur_bucket->vertices.data, cur_bucket->vertices.capacity * elem_size);
+    }
+
+    dest = (byte *) cur_bucket->vertices.data + cur_bucket->vertices.count * elem_size;
+    for(size_t i = 0; i < count; i++)
+        meshbuilder_add_index(cur_bucket->vertices.count + i);
+    cur_bucket->vertices.count += count;
+
+    return dest;
+}
@@ -7,10 +7,18 @@
 #define MESHBUILDER_INDEX_TYPE    uint16_t
 #define MESHBUILDER_INDEX_TYPE_GL GL_UNSIGNED_SHORT
 
+#define MESHBUILDER_MAX_BUCKETS 32
+
 void meshbuilder_start(size_t vert_size);
 
+// vertices added after this call go to the given bucket (0 by default)
+void meshbuilder_set_bucket(size_t bucket);
+
+// buckets are stored one after another, bucket_sizes_dest (if not NULL) receives
+// MESHBUILDER_MAX_BUCKETS vertex counts
 void meshbuilder_finish(void **verts_dest, size_t *num_verts_dest,
-                        MESHBUILDER_INDEX_TYPE **indices_dest, size_t *num_indices_dest);
+                        MESHBUILDER_INDEX_TYPE **indices_dest, size_t *num_indices_dest,
+                        size_t *bucket_sizes_dest);
 
 void meshbuilder_add_index(MESHBUILDER_INDEX_TYPE index);
 
@@ -18,4 +26,7 @@ void meshbuilder_add_vert(void *vert);
 
 void meshbuilder_add_quad(void *top_left, void *top_right, void *bottom_left, void *bottom_right);
 
+// appends count vertices with their indices and returns them for the caller to fill in
+void *meshbuilder_add_verts(size_t count);
+
 #endif
@@ -0,0 +1,215 @@
+#include "occlusion.h"
+#include "common.h"
+#include <math.h>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+/* points closer than this (in view space) are treated as being behind the camera */
+#define NEAR_W 0.05f
+
+/* stores view space depth (clip w), so that the depth of a face can be
+ * compared against a box without any perspective divide */
+static float depth[OCCLUSION_HEIGHT][OCCLUSION_WIDTH];
+static mat4_t view_proj;
+static vec3_t camera;
+
+struct screen_vert {
+    float x, y, w;
+};
+
+static bool project(vec3_t p, struct screen_vert *out)
+{
+    vec4_t clip = mat4_multiply_vec4(view_proj, vec4(p.x, p.y, p.z, 1.0f));
+
+    if(clip.w < NEAR_W)
+        return false;
+
+    out->x = (clip.x / clip.w * 0.5f + 0.5f) * OCCLUSION_WIDTH;
+    out->y = (0.5f - clip.y / clip.w * 0.5f) * OCCLUSION_HEIGHT;
+    out->w = clip.w;
+    return true;
+}
+
+void occlusion_begin(mat4_t view, mat4_t proj, vec3_t cam_pos)
+{
+    mat4_multiply(view_proj, view, proj);
+    camera = cam_pos;
+
+    for(int y = 0; y < OCCLUSION_HEIGHT; y++) {
+        for(int x = 0; x < OCCLUSION_WIDTH; x++)
+            depth[y][x] = INFINITY;
+    }
+}
+
+/* the projected face of a box is a convex quad. it is rasterized as a whole, because splitting
+ * it into two triangles would leave the pixels along the shared edge uncovered */
+static void rasterize_quad(struct screen_vert v[4], float w)
+{
+    float area = 0.0f;
+    float a[4], b[4], c[4];
+    int min_x, min_y, max_x, max_y;
+#ifdef __SSE__
+    __m128 zero, wv, step;
+#endif
+
+    for(int i = 0; i < 4; i++)
+        area += v[i].x * v[(i + 1) % 4].y - v[(i + 1) % 4].x * v[i].y;
+
+    if(fabsf(area) < 0.0001f)
+        return;
+
+    /* edge functions, positive inside. they are evaluated at pixel centers and moved inwards
+     * by half a pixel in both axes, so only pixels lying completely inside pass */
+    for(int i = 0; i < 4; i++) {
+        struct screen_vert *p = &v[i], *q = &v[(i + 1) % 4];
+        a[i] = -(q->y - p->y);
+        b[i] = q->x - p->x;
+        if(area < 0) {
+            a[i] = -a[i];
+            b[i] = -b[i];
+        }
+        c[i] = -(a[i] * p->x + b[i] * p->y) - 0.5f * (fabsf(a[i]) + fabsf(b[i]));
+    }
+
+    min_x = max(0, (int) floorf(min(min(v[0].x, v[1].x), min(v[2].x, v[3].x))));
+    min_y = max(0, (int) floorf(min(min(v[0].y, v[1].y), min(v[2].y, v[3].y))));
+    max_x = min(OCCLUSION_WIDTH - 1, (int) ceilf(max(max(v[0].x, v[1].x), max(v[2].x, v[3].x))));
+    max_y = min(OCCLUSION_HEIGHT - 1, (int) ceilf(max(max(v[0].y, v[1].y), max(v[2].y, v[3].y))));
+
+    min_x &= ~3;
+
+#ifdef __SSE__
+    zero = _mm_setzero_ps();
+    wv = _mm_set1_ps(w);
+    step = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+
+    for(int y = min_y; y <= max_y; y++) {
+        __m128 row[4];
+
+        for(int i = 0; i < 4; i++)
+            row[i] = _mm_set1_ps(b[i] * (y + 0.5f) + c[i]);
+
+        for(int x = min_x; x <= max_x; x += 4) {
+            __m128 px = _mm_add_ps(_mm_set1_ps((float) x), step);
+            __m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[0]), px), row[0]), zero);
+            __m128 d;
+
+            for(int i = 1; i < 4; i++)
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[i]), px), row[i]), zero));
+
+            d = _mm_loadu_ps(&depth[y][x]);
+            d = _mm_or_ps(_mm_and_ps(inside, _mm_min_ps(d, wv)), _mm_andnot_ps(inside, d));
+            _mm_storeu_ps(&depth[y][x], d);
+        }
+    }
+#else
+    for(int y = min_y; y <= max_y; y++) {
+        for(int x = min_x; x <= max_x; x++) {
+            float px = x + 0.5f, py = y + 0.5f;
+            bool inside = true;
+
+            for(int i = 0; i < 4; i++)
+                inside = inside && a[i] * px + b[i] * py + c[i] >= 0;
+
+            if(inside && w < depth[y][x])
+                depth[y][x] = w;
+        }
+    }
+#endif
+}
+
+void occlusion_add_occluder(vec3_t mins, vec3_t maxs)
+{
+    /* corners of every face, in order around the face */
+    static const int faces[6][4][3] = {
+            {{0, 0, 0}, {1, 0, 0}, {1, 0, 1}, {0, 0, 1}}, // -Y
+            {{0, 1, 0}, {0, 1, 1}, {1, 1, 1}, {1, 1, 0}}, // +Y
+            {{0, 0, 0}, {0, 1, 0}, {1, 1, 0}, {1, 0, 0}}, // -Z
+            {{0, 0, 1}, {1, 0, 1}, {1, 1, 1}, {0, 1, 1}}, // +Z
+            {{0, 0, 0}, {0, 0, 1}, {0, 1, 1}, {0, 1, 0}}, // -X
+            {{1, 0, 0}, {1, 1, 0}, {1, 1, 1}, {1, 0, 1}}  // +X
+    };
+    bool facing[6] = {
+            camera.y < mins.y, camera.y > maxs.y,
+            camera.z < mins.z, camera.z > maxs.z,
+            camera.x < mins.x, camera.x > maxs.x
+    };
+
+    for(int f = 0; f < 6; f++) {
+        struct screen_vert v[4];
+        float w = 0.0f;
+        bool ok = true;
+
+        if(!facing[f])
+            continue;
+
+        for(int i = 0; i < 4 && ok; i++) {
+            vec3_t p = vec3(faces[f][i][0] ? maxs.x : mins.x,
+                            faces[f][i][1] ? maxs.y : mins.y,
+                            faces[f][i][2] ? maxs.z : mins.z);
+            ok = project(p, &v[i]);
+            w = max(w, v[i].w);
+        }
+
+        /* faces crossing the near plane are skipped rather than clipped, which is still conservative */
+        if(!ok)
+            continue;
+
+        /* the farthest corner is used for the whole face, the face can only be closer than that */
+        rasterize_quad(v, w);
+    }
+}
+
+bool occlusion_test_box(vec3_t mins, vec3_t maxs)
+{
+    float min_x = INFINITY, min_y = INFINITY, max_x = -INFINITY, max_y = -INFINITY, min_w = INFINITY;
+    int x0, y0, x1, y1;
+#ifdef __SSE__
+    __m128 wv;
+#endif
+
+    for(int i = 0; i < 8; i++) {
+        struct screen_vert v;
+        vec3_t p = vec3(i & 1 ? maxs.x : mins.x, i & 2 ? maxs.y : mins.y, i & 4 ? maxs.z : mins.z);
+
+        if(!project(p, &v))
+            return true;
+
+        min_x = min(min_x, v.x);
+        min_y = min(min_y, v.y);
+        max_x = max(max_x, v.x);
+        max_y = max(max_y, v.y);
+        min_w = min(min_w, v.w);
+    }
+
+    x0 = max(0, (int) floorf(min_x)) & ~3;
+    y0 = max(0, (int) floorf(min_y));
+    x1 = min(OCCLUSION_WIDTH - 1, (int) ceilf(max_x));
+    y1 = min(OCCLUSION_HEIGHT - 1, (int) ceilf(max_y));
+
+    /* off screen, the frustum test would've caught this */
+    if(x0 > x1 || y0 > y1)
+        return true;
+
+#ifdef __SSE__
+    wv = _mm_set1_ps(min_w);
+
+    for(int y = y0; y <= y1; y++) {
+        for(int x = x0; x <= x1; x += 4) {
+            if(_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(&depth[y][x]), wv)))
+                return true;
+        }
+    }
+#else
+    for(int y = y0; y <= y1; y++) {
+        for(int x = x0; x <= x1; x++) {
+            if(depth[y][x] >= min_w)
+                return true;
+        }
+    }
+#endif
+
+    return false;
+}
@@ -0,0 +1,20 @@
+#ifndef B173C_OCCLUSION_H
+#define B173C_OCCLUSION_H
+
+#include "mathlib.h"
+
+/* size of the software depth buffer, the width has to be a multiple of 4 */
+#define OCCLUSION_WIDTH  256
+#define OCCLUSION_HEIGHT 128
+
+/* clears the depth buffer and sets up the camera for the following calls */
+void occlusion_begin(mat4_t view, mat4_t proj, vec3_t cam_pos);
+
+/* draws the faces of a box that face the camera. only pixels that are completely
+ * covered get written, so an occluder never hides more than it really does */
+void occlusion_add_occluder(vec3_t mins, vec3_t maxs);
+
+/* false if every pixel the box could touch is behind an occluder */
+bool occlusion_test_box(vec3_t mins, vec3_t maxs);
+
+#endif
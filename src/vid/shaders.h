@@ -12,4 +12,7 @@ extern const char *text_f_glsl;
 extern const char *model_v_glsl;
 extern const char *model_f_glsl;
 
+extern const char *lod_v_glsl;
+extern const char *lod_f_glsl;
+
 #endif
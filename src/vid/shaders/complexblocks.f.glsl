@@ -1,23 +1,45 @@
 #version 430 core
 
 in vec3 COLORMOD;
-in vec2 UV_COORD;
+in vec3 UV_COORD;
+in vec3 LOCAL_POS;
+flat in vec3 NORMAL;
+flat in ivec3 LIGHT_OFS;
+flat in int SELECTION_BOX;
+flat in float OVERLAY_LAYER;
+flat in vec3 OVERLAY_TINT;
 
 out vec4 COLOR;
 
-uniform vec3 CHUNK_POS;
-uniform sampler2D TEXTURE;
+uniform sampler2DArray TEXTURE;
+uniform usampler3D LIGHT_TEX;
 
 void main()
 {
-    // hack for block selection box
-    if (CHUNK_POS == vec3(0) && COLORMOD == vec3(0) && UV_COORD == vec2(0)) {
+    if (SELECTION_BOX != 0) {
          COLOR = vec4(0.0, 0.0, 0.0, 0.4);
          return;
     }
 
-    COLOR = texture(TEXTURE, UV_COORD) * vec4(COLORMOD, 1.0);
+    COLOR = texture(TEXTURE, UV_COORD);
+    if (OVERLAY_LAYER >= 0.0) {
+        vec4 overlay = texture(TEXTURE, vec3(UV_COORD.xy, OVERLAY_LAYER));
+        COLOR.rgb = mix(COLOR.rgb, overlay.rgb * OVERLAY_TINT, overlay.a);
+    }
+    // a face is lit by the block in front of it, the light area of a chunk has a one block border
+    // around x and z so those are shifted by one
+    vec3 p = floor(LOCAL_POS + NORMAL * 0.01);
+    ivec3 coords = clamp(ivec3(p.x + 1.0, p.z + 1.0, p.y), ivec3(0), ivec3(17, 17, 127));
+    uint light = texelFetch(LIGHT_TEX, LIGHT_OFS + coords, 0).r & 0xffu;
+
+    COLOR *= vec4(COLORMOD * (float(light) / 15.0), 1.0);
+#ifdef PASS_CUTOUT
+    // only the cutout pass may discard, so that the others keep early depth testing
     if (COLOR.a < 0.01) {
         discard;
     }
-}
\ No newline at end of file
+#endif
+#ifdef PASS_OPAQUE
+    COLOR.a = 1.0;
+#endif
+}
@@ -4,59 +4,48 @@ layout(location=0) in vec3 IN_POS;
 layout(location=1) in vec2 IN_UV;
 layout(location=2) in uint IN_DATA;
 layout(location=3) in ivec3 IN_COLORMOD;
+layout(location=4) in uint IN_DRAW_ID;
+
+struct chunk_info {
+    ivec4 origin;
+    ivec4 light_ofs;
+};
+
+layout(std430, binding=0) readonly buffer CHUNK_INFO {
+    chunk_info CHUNKS[];
+};
 
-uniform vec3 CHUNK_POS;
 uniform mat4 VIEW;
 uniform mat4 PROJECTION;
 uniform float NIGHTTIME_LIGHT_MODIFIER;
-uniform usampler3D LIGHT_TEX;
+uniform int GRASS_SIDE_LAYER; // -1 without fancy grass
+uniform int GRASS_OVERLAY_LAYER;
+uniform float DETAIL_DISTANCE; // no overlay beyond it, 0 for no limit
 
-out vec2 UV_COORD;
+out vec3 UV_COORD; // u, v, layer
 out vec3 COLORMOD;
+out vec3 LOCAL_POS; // position inside the chunk, the fragment shader looks the light up with it
+flat out vec3 NORMAL;
+flat out ivec3 LIGHT_OFS;
+flat out float OVERLAY_LAYER; // negative for none
+flat out vec3 OVERLAY_TINT;
+flat out int SELECTION_BOX;
 
-vec2 get_uv_coord(uint texture_index)
-{
-    vec2 ofs = IN_UV;
-    ofs.x += texture_index % 16;
-    ofs.y += texture_index / 16;
-    ofs /= 16.0;
-    return ofs;
-}
+const vec3 FACE_NORMALS[6] = vec3[6](
+    vec3(0, -1, 0), vec3(0, 1, 0),
+    vec3(0, 0, -1), vec3(0, 0, 1),
+    vec3(-1, 0, 0), vec3(1, 0, 0)
+);
 
 void main()
 {
-    uint texture_index, face, light, bl, sl;
+    uint texture_index, face;
+    chunk_info info = CHUNKS[IN_DRAW_ID];
 
     texture_index = ((IN_DATA & uint(0x00ff)) >> 0) & 255u;
     face          = ((IN_DATA & uint(0xff00)) >> 8) & 7u;
 
-    vec3 coords = vec3((IN_POS.x), (IN_POS.z), floor(IN_POS.y));
-    vec3 offset = vec3(999);
-
-    float d = 1;
-    if(face == 0)
-        offset = vec3(0, 0, -d);
-    else if(face == 1)
-        offset = vec3(0, 0, d);
-    else if(face == 2)
-        offset = vec3(0, 0, -d);
-    else if(face == 3)
-        offset = vec3(0, 0, d);
-    else if(face == 4)
-        offset = vec3(-d, 0, 0);
-    else if(face == 5)
-        offset = vec3(d, 0, 0);
-    //coords += offset;
-    coords.x /= 32.0;
-    coords.y /= 32.0;
-    coords.z /= 128.0;
-    coords.x += 1 / 32.0;
-    coords.y += 1 / 32.0;
-    coords.z += 1 / 128.0;
-
-    light = uint(texture(LIGHT_TEX, coords).r) & 0xffu;
-
-    COLORMOD = vec3(1);//vec3(IN_COLORMOD.rgb / 255.0f);
+    COLORMOD = vec3(1);
     if (face == 0) { // -Y
         COLORMOD *= 0.5;
     } else if (face == 1) { // +Y
@@ -67,11 +56,20 @@ void main()
         COLORMOD *= 0.6;
     }
 
-    COLORMOD *= float(light) / 255.0f; // * NIGHTTIME_LIGHT_MODIFIER;
+    LOCAL_POS = IN_POS;
+    NORMAL = FACE_NORMALS[min(face, 5u)];
+    LIGHT_OFS = info.light_ofs.xyz;
+
+    vec3 block_pos = IN_POS + vec3(info.origin.xyz);
 
-    vec3 block_pos = IN_POS + CHUNK_POS;
+    UV_COORD = vec3(IN_UV, float(texture_index));
 
-    UV_COORD = get_uv_coord(texture_index);
+    // grass sides get the overlay blended on top in the fragment shader instead of a second quad
+    OVERLAY_LAYER = int(texture_index) == GRASS_SIDE_LAYER ? float(GRASS_OVERLAY_LAYER) : -1.0;
+    if (DETAIL_DISTANCE > 0.0 && length((VIEW * vec4(block_pos, 1.0)).xyz) > DETAIL_DISTANCE)
+        OVERLAY_LAYER = -1.0;
+    OVERLAY_TINT = vec3(IN_COLORMOD) / 255.0;
+    SELECTION_BOX = IN_DRAW_ID == 0u ? 1 : 0;
 
     gl_Position = PROJECTION * VIEW * (vec4(block_pos, 1.0));
 }
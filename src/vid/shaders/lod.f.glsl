@@ -0,0 +1,10 @@
+#version 430 core
+
+in vec3 COLORMOD;
+
+out vec4 COLOR;
+
+void main()
+{
+    COLOR = vec4(COLORMOD, 1.0);
+}
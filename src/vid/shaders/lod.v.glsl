@@ -0,0 +1,24 @@
+#version 430 core
+
+layout(location=0) in vec3 IN_POS;
+layout(location=1) in vec3 IN_COLOR;
+layout(location=2) in uint IN_FACE;
+
+uniform mat4 VIEW;
+uniform mat4 PROJECTION;
+
+out vec3 COLORMOD;
+
+void main()
+{
+    COLORMOD = IN_COLOR;
+    if (IN_FACE == 0u) { // -Y
+        COLORMOD *= 0.5;
+    } else if (IN_FACE == 2u || IN_FACE == 3u) { // +-Z
+        COLORMOD *= 0.8;
+    } else if (IN_FACE == 4u || IN_FACE == 5u) { // +-X
+        COLORMOD *= 0.6;
+    }
+
+    gl_Position = PROJECTION * VIEW * vec4(IN_POS, 1.0);
+}
@@ -1,8 +1,8 @@
 #version 430 core
 
 layout(location = 0) in vec3 VERTEX;
+layout(location = 1) in mat4 MODEL; // per instance
 
-uniform mat4 MODEL;
 uniform mat4 VIEW;
 uniform mat4 PROJECTION;
 
@@ -8,10 +8,12 @@ out vec2 UV;
 flat out int FONTCHAR;
 flat out int FONTCOLOR;
 
+uniform vec2 OFFSET; // of the glyph run, 0 for immediate text
+
 void main()
 {
     // multiply by 2 and move because screen coordinates range from -1 to 1
-    vec2 org = 2.0 * VERTEX + 2.0 * vec2(FONTDATA.x, -FONTDATA.y);
+    vec2 org = 2.0 * VERTEX + 2.0 * vec2(FONTDATA.x + OFFSET.x, -(FONTDATA.y + OFFSET.y));
     org -= vec2(1.0, -1.0);
 
     gl_Position = vec4(org, -1.0, 1.0);
@@ -7,12 +7,20 @@
 #include "vid.h"
 #include "client/client.h"
 #include "assets.h"
+#include "gpu_heap.h"
+#include "hashmap.c/hashmap.h"
 #include "client/cvar.h"
 #include "../client/client.h"
 
 // arbitrary limit, can be increased safely
 #define MAX_CON_CHARS 8192
 
+// immediate text (ui_drawchar, ui_printf) of the frames that may still be in flight
+#define UI_DELTA_FRAMES 3
+
+// frames a glyph run may go unused before it is dropped
+#define UI_RUN_MAX_AGE 120
+
 #define _CON_CHAR_SIZE 8
 #define CON_CHAR_SPACE_WIDTH 6
 
@@ -35,14 +43,45 @@ vec2_t glyph_vertices[] = {
 };
 
 float char_widths[256] = {0};
-vec4_t text_data[MAX_CON_CHARS] = {0};
+static vec4_t text_data_fallback[MAX_CON_CHARS] = {0};
+vec4_t *text_data = text_data_fallback;
 int text_char_count = 0;
-uint32_t gl_ui_font_texture, gl_uniform_con_char_size;
+uint32_t gl_ui_font_texture, gl_uniform_con_char_size, gl_uniform_text_offset;
 uint32_t gl_text_vao, gl_text_glyph_vbo = 0, gl_text_data_buffer;
 asset_image *asset_font_image = NULL;
 
 extern struct gl_state gl;
 
+/* with gl 4.4 immediate text is written straight into a persistently mapped buffer, one region
+ * per frame in flight. otherwise it is collected in text_data_fallback and uploaded at the end */
+static struct {
+    vec4_t *map;
+    GLsync fences[UI_DELTA_FRAMES];
+    int frame;
+} delta;
+
+/* a laid out string: glyph positions are relative to the top left corner of the run and
+ * normalized to the ui size, so the cache is dropped whenever the ui size changes */
+struct ui_run {
+    char *text;
+    int wrap_width;
+    size_t offset, count; // glyphs in run_heap
+    int width, rows;
+    uint32_t *row_start; // rows + 1 glyph indices
+    uint64_t last_used;
+};
+
+static struct hashmap *run_cache; // of struct ui_run *
+static gpu_heap run_heap;
+static uint64_t ui_frame;
+
+// runs queued for this frame
+static struct run_draw {
+    size_t first, count;
+    float x, y;
+} *run_draws;
+static size_t num_run_draws, run_draws_capacity;
+
 void ui_update_size(int x, int y)
 {
     int i;
@@ -57,6 +96,12 @@ void ui_update_size(int x, int y)
         glyph_vertices[i].y -= _CON_CHAR_SIZE / (float)(ui_h); // move origin of the font polygon to the top left corner
     }
 
+    // laid out for the old size
+    if(run_cache) {
+        hashmap_clear(run_cache, false);
+        num_run_draws = 0;
+    }
+
     // this function could possibly be called before the buffer was created
     if(gl_text_glyph_vbo) {
         glBindBuffer(GL_ARRAY_BUFFER, gl_text_glyph_vbo);
@@ -116,6 +161,239 @@ static void calculate_char_widths(void)
     }
 }
 
+/* handles the character after CON_STYLE_PREFIX_CHAR, returns the text after the style code */
+static char *read_style_code(char *text, byte *color, bool *invisible, float *x)
+{
+    switch(*text) {
+        case '\0':
+            return text;
+        case 'i':
+            *invisible = true;
+            return text + 1;
+        case 'p':
+            *x += strtol(text + 1, &text, 10);
+            return text;
+    }
+
+    if(isdigit(*text))
+        *color = *text - '0'; // convert to decimal
+    else if(*text >= 'a' && *text <= 'f')
+        *color = *text - 'a' + 0xa; // convert to hex
+    else
+        *color = 0x0; // black
+
+    if(*color < 0x0 || *color > 0xf)
+        *color = 0xf;
+
+    *invisible = false;
+    return text + 1;
+}
+
+static uint64_t run_hash(const void *item, uint64_t seed0, uint64_t seed1)
+{
+    const struct ui_run *run = *(struct ui_run * const *) item;
+    return hashmap_xxhash3(run->text, strlen(run->text), seed0 ^ (uint64_t) run->wrap_width, seed1);
+}
+
+static int run_compare(const void *a, const void *b, void *udata attr(unused))
+{
+    const struct ui_run *ra = *(struct ui_run * const *) a;
+    const struct ui_run *rb = *(struct ui_run * const *) b;
+    if(ra->wrap_width != rb->wrap_width)
+        return ra->wrap_width - rb->wrap_width;
+    return strcmp(ra->text, rb->text);
+}
+
+static void run_free(void *item)
+{
+    struct ui_run *run = *(struct ui_run **) item;
+
+    if(run->count > 0)
+        gpu_heap_free(&run_heap, run->offset, run->count);
+    mem_free(run->text);
+    mem_free(run->row_start);
+    mem_free(run);
+}
+
+static void add_glyph(vec4_t *glyphs, size_t *count, float x, float y, ubyte character, int color)
+{
+    if(color > 0) // shadow
+        add_glyph(glyphs, count, x + 1, y + 1, character, -color);
+
+    glyphs[*count] = vec4(x, y, character, color);
+    (*count)++;
+}
+
+/* lays out the text the same way ui_drawtext draws it. lines longer than wrap_width (if > 0) are
+ * broken after their last space, or anywhere if there is none. spaces get no glyphs */
+static struct ui_run *build_run(const char *text, int wrap_width)
+{
+    static vec4_t glyphs[MAX_CON_CHARS];
+    static uint32_t row_start[MAX_CON_CHARS + 1];
+    struct ui_run *run = mem_alloc(sizeof(*run));
+    size_t len = strlen(text), count = 0, space = 0;
+    byte color = 0xf;
+    bool invisible = false;
+    float x = 0, space_x = 0, width = 0;
+    int rows = 1;
+    char *p;
+
+    run->text = mem_alloc(len + 1);
+    memcpy(run->text, text, len + 1);
+    run->wrap_width = wrap_width;
+    row_start[0] = 0;
+
+    p = run->text;
+    while(*p && count < MAX_CON_CHARS - 2 && rows < MAX_CON_CHARS) {
+        int w;
+
+        if(*p == CON_STYLE_PREFIX_CHAR) {
+            p = read_style_code(p + 1, &color, &invisible, &x);
+            continue;
+        }
+
+        if(*p == '\n') {
+            if(p[1] != '\0') {
+                width = max(width, x);
+                row_start[rows++] = count;
+                space = count;
+                x = 0;
+            }
+            p++;
+            continue;
+        }
+
+        w = ui_charwidth(*p);
+        if(wrap_width > 0 && x + w > wrap_width && x > 0) {
+            if(space > row_start[rows - 1]) {
+                /* everything after the last space moves down a row */
+                for(size_t i = space; i < count; i++) {
+                    glyphs[i].x -= space_x;
+                    glyphs[i].y += LINE_HEIGHT_PX;
+                }
+                width = max(width, space_x);
+                x -= space_x;
+                row_start[rows++] = space;
+            } else {
+                width = max(width, x);
+                x = 0;
+                row_start[rows++] = count;
+            }
+            space = row_start[rows - 1];
+        }
+
+        if(isspace((ubyte) *p)) {
+            space = count;
+            space_x = x + w;
+        } else if(!invisible) {
+            add_glyph(glyphs, &count, x, (rows - 1) * LINE_HEIGHT_PX, *p, color);
+        }
+
+        x += w;
+        p++;
+    }
+    row_start[rows] = count;
+
+    for(size_t i = 0; i < count; i++) {
+        glyphs[i].x /= (float) ui_w;
+        glyphs[i].y /= (float) ui_h;
+    }
+
+    run->width = (int) max(width, x);
+    run->rows = rows;
+    run->row_start = mem_alloc((rows + 1) * sizeof(uint32_t));
+    memcpy(run->row_start, row_start, (rows + 1) * sizeof(uint32_t));
+
+    run->offset = gpu_heap_alloc(&run_heap, count);
+    run->count = run->offset == GPU_HEAP_INVALID ? 0 : count;
+    gpu_heap_upload(&run_heap, run->offset, run->count, glyphs);
+
+    return run;
+}
+
+const ui_run *ui_get_run(const char *text, int wrap_width)
+{
+    struct ui_run key = {.text = (char *) text, .wrap_width = wrap_width}, *run = &key;
+    struct ui_run **cached = (struct ui_run **) hashmap_get(run_cache, &run);
+
+    if(cached) {
+        run = *cached;
+    } else {
+        run = build_run(text, wrap_width);
+        hashmap_set(run_cache, &run);
+    }
+
+    run->last_used = ui_frame;
+    return run;
+}
+
+int ui_run_rows(const ui_run *run)
+{
+    return run->rows;
+}
+
+int ui_run_width(const ui_run *run)
+{
+    return run->width;
+}
+
+void ui_drawrun(float x, float y, const ui_run *run, int first_row, int num_rows)
+{
+    struct run_draw *draw;
+    size_t first, count;
+
+    first_row = bound(0, first_row, run->rows);
+    num_rows = bound(0, num_rows, run->rows - first_row);
+
+    if(y + num_rows * LINE_HEIGHT_PX <= 0 || y >= ui_h || x >= ui_w)
+        return;
+
+    first = run->row_start[first_row];
+    count = run->row_start[first_row + num_rows] - first;
+    if(count == 0)
+        return;
+
+    if(num_run_draws == run_draws_capacity) {
+        run_draws_capacity = run_draws_capacity ? run_draws_capacity * 2 : 64;
+        run_draws = realloc(run_draws, run_draws_capacity * sizeof(*run_draws));
+    }
+
+    draw = &run_draws[num_run_draws++];
+    draw->first = run->offset + first;
+    draw->count = count;
+    draw->x = x;
+    draw->y = y - first_row * LINE_HEIGHT_PX;
+}
+
+int ui_drawstatic(float x, float y, const char *text)
+{
+    const ui_run *run = ui_get_run(text, 0);
+    ui_drawrun(x, y, run, 0, run->rows);
+    return run->width;
+}
+
+static void evict_unused_runs(void)
+{
+    struct ui_run **stale = NULL;
+    size_t num_stale = 0, i = 0;
+    void *it;
+
+    while(hashmap_iter(run_cache, &i, &it)) {
+        struct ui_run *run = *(struct ui_run **) it;
+        if(ui_frame - run->last_used > UI_RUN_MAX_AGE) {
+            stale = realloc(stale, (num_stale + 1) * sizeof(*stale));
+            stale[num_stale++] = run;
+        }
+    }
+
+    for(i = 0; i < num_stale; i++) {
+        hashmap_delete(run_cache, &stale[i]);
+        run_free(&stale[i]);
+    }
+
+    free(stale);
+}
+
 errcode ui_init(void)
 {
     asset_font_image = asset_get_image(ASSET_TEXTURE_FONT_DEFAULT);
@@ -145,12 +423,30 @@ errcode ui_init(void)
 
         // instance data
         glBindBuffer(GL_ARRAY_BUFFER, gl_text_data_buffer);
+        if(GLAD_GL_VERSION_4_4) {
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_ARRAY_BUFFER, UI_DELTA_FRAMES * MAX_CON_CHARS * sizeof(vec4_t), NULL, flags);
+            delta.map = glMapBufferRange(GL_ARRAY_BUFFER, 0, UI_DELTA_FRAMES * MAX_CON_CHARS * sizeof(vec4_t), flags);
+            if(delta.map)
+                text_data = delta.map;
+        }
         glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(vec4_t), (void *) 0);
         glEnableVertexAttribArray(2);
         glVertexAttribDivisor(2, 1);
     glBindVertexArray(0);
 
+    if(GLAD_GL_VERSION_4_4 && !delta.map) {
+        /* storage is immutable, start over with a plain buffer */
+        con_printf("failed to map the text buffer, falling back to glBufferData\n");
+        glDeleteBuffers(1, &gl_text_data_buffer);
+        glGenBuffers(1, &gl_text_data_buffer);
+    }
+
+    gpu_heap_init(&run_heap, sizeof(vec4_t), MAX_CON_CHARS);
+    run_cache = hashmap_new(sizeof(struct ui_run *), 0, 0, 0, run_hash, run_compare, run_free, NULL);
+
     gl_uniform_con_char_size = glGetUniformLocation(gl.shader_text, "CON_CHAR_SIZE");
+    gl_uniform_text_offset = glGetUniformLocation(gl.shader_text, "OFFSET");
 
     ui_update_size(vid_width.integer, vid_height.integer);
 
@@ -171,7 +467,31 @@ errcode ui_init(void)
 
 void ui_shutdown(void)
 {
+    hashmap_free(run_cache);
+    run_cache = NULL;
+    gpu_heap_shutdown(&run_heap);
+    mem_free(run_draws);
+    num_run_draws = run_draws_capacity = 0;
+
+    for(int i = 0; i < UI_DELTA_FRAMES; i++) {
+        if(delta.fences[i])
+            glDeleteSync(delta.fences[i]);
+        delta.fences[i] = NULL;
+    }
 
+    if(delta.map) {
+        glBindBuffer(GL_ARRAY_BUFFER, gl_text_data_buffer);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        delta.map = NULL;
+    }
+    text_data = text_data_fallback;
+
+    glDeleteVertexArrays(1, &gl_text_vao);
+    glDeleteBuffers(1, &gl_text_glyph_vbo);
+    glDeleteBuffers(1, &gl_text_data_buffer);
+    glDeleteTextures(1, &gl_ui_font_texture);
+    gl_text_glyph_vbo = 0;
 }
 
 void ui_draw(void)
@@ -183,40 +503,86 @@ void ui_render(void)
 {
     if(developer.integer) {
         float x = 1;
-        float y = -8 + 1;
-        ui_printf(x, y+=8, "b173c 0.0.0 (%lu fps)", cl.fps);
-        ui_printf(x, y+=48, "x: %.14f (%d)", cl.game.our_ent->position.x, (int)cl.game.our_ent->position.x >> 4);
-        ui_printf(x, y+=8, "y: %.14f", cl.game.our_ent->position.y);
-        ui_printf(x, y+=8, "z: %.14f (%d)", cl.game.our_ent->position.z, (int)cl.game.our_ent->position.z >> 4);
-        ui_printf(x, y+=8, "state: %d %d/%d %d %f %f %f", cl.game.our_ent->onground,
-                  cl.game.our_ent->collided_horizontally, cl.game.our_ent->collided_vertically,
-                  entity_in_water(cl.game.our_ent) || entity_in_lava(cl.game.our_ent),
-                  cl.game.our_ent->velocity.x, cl.game.our_ent->velocity.y, cl.game.our_ent->velocity.z);
-        ui_printf(x, y+=8, "looking at: %d %d %d / %d / %d ("BIN_FMT") / %s", vec3_unpack(cl.game.look_trace),
-                  cl.game.look_trace.block.id, cl.game.look_trace.block.metadata, BIN_BYTE(cl.game.look_trace.block.metadata),
-                  block_face_to_str(cl.game.look_trace.hit_face));
-        ui_printf(x, y+=24, "Seed: %ld", cl.game.seed);
-        ui_printf(x, y+=8, "Time: %lu (day %lu)", cl.game.time, cl.game.time / 24000);
+        float y = 1;
+        entity *ent = cl.game.our_ent;
+        struct trace_result *look = &cl.game.look_trace;
+
+        /* labels are retained, only the numbers are redrawn every frame */
+        ui_printf(x + ui_drawstatic(x, y, "b173c 0.0.0 "), y, "(%lu fps)", cl.fps);
+        y += 48;
+        ui_printf(x + ui_drawstatic(x, y, "x: "), y, "%.14f (%d)", ent->position.x, (int)ent->position.x >> 4);
+        y += 8;
+        ui_printf(x + ui_drawstatic(x, y, "y: "), y, "%.14f", ent->position.y);
+        y += 8;
+        ui_printf(x + ui_drawstatic(x, y, "z: "), y, "%.14f (%d)", ent->position.z, (int)ent->position.z >> 4);
+        y += 8;
+        ui_printf(x + ui_drawstatic(x, y, "state: "), y, "%d %d/%d %d %f %f %f", ent->onground,
+                  ent->collided_horizontally, ent->collided_vertically,
+                  entity_in_water(ent) || entity_in_lava(ent),
+                  ent->velocity.x, ent->velocity.y, ent->velocity.z);
+        y += 8;
+        ui_printf(x + ui_drawstatic(x, y, "looking at: "), y, "%d %d %d / %d / %d ("BIN_FMT") / %s", vec3_unpack(*look),
+                  look->block.id, look->block.metadata, BIN_BYTE(look->block.metadata),
+                  block_face_to_str(look->hit_face));
+        y += 24;
+        ui_printf(x + ui_drawstatic(x, y, "Seed: "), y, "%ld", cl.game.seed);
+        y += 8;
+        ui_printf(x + ui_drawstatic(x, y, "Time: "), y, "%lu (day %lu)", cl.game.time, cl.game.time / 24000);
     }
 
     // crosshair
     // assume the char is a square :P
     // todo: crosshair cvar? later
-    ui_printf((float)ui_w / 2.0f - (float)ui_charwidth('\x9') / 2.0f,
-              (float)ui_h / 2.0f - (float)ui_charwidth('\x9') / 2.0f,
-              "%c", '\x9');
-
-    glBindBuffer(GL_ARRAY_BUFFER, gl_text_data_buffer);
-    // todo: update only parts of the buffer that were changed?
-    glBufferData(GL_ARRAY_BUFFER, text_char_count * sizeof(vec4_t), text_data, GL_STREAM_DRAW);
+    ui_drawstatic((float)ui_w / 2.0f - (float)ui_charwidth('\x9') / 2.0f,
+                  (float)ui_h / 2.0f - (float)ui_charwidth('\x9') / 2.0f,
+                  "\x9");
 
     glUniform1i(gl_uniform_con_char_size, CON_CHAR_SIZE);
 
     glBindVertexArray(gl_text_vao);
     glBindTexture(GL_TEXTURE_2D, gl_ui_font_texture);
-    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, text_char_count);
+
+    /* retained runs, each moved into place by OFFSET */
+    glBindBuffer(GL_ARRAY_BUFFER, run_heap.buffer);
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(vec4_t), (void *) 0);
+    for(size_t i = 0; i < num_run_draws; i++) {
+        struct run_draw *draw = &run_draws[i];
+        glUniform2f(gl_uniform_text_offset, draw->x / (float) ui_w, draw->y / (float) ui_h);
+        glDrawArraysInstancedBaseInstance(GL_TRIANGLE_STRIP, 0, 4, draw->count, draw->first);
+    }
+    num_run_draws = 0;
+
+    /* immediate text of this frame */
+    glBindBuffer(GL_ARRAY_BUFFER, gl_text_data_buffer);
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(vec4_t), (void *) 0);
+    glUniform2f(gl_uniform_text_offset, 0, 0);
+    if(delta.map) {
+        glDrawArraysInstancedBaseInstance(GL_TRIANGLE_STRIP, 0, 4, text_char_count, delta.frame * MAX_CON_CHARS);
+
+        delta.fences[delta.frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        delta.frame = (delta.frame + 1) % UI_DELTA_FRAMES;
+
+        /* the region of the next frame was last drawn UI_DELTA_FRAMES frames ago */
+        if(delta.fences[delta.frame]) {
+            GLenum status;
+            do {
+                status = glClientWaitSync(delta.fences[delta.frame], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+            } while(status == GL_TIMEOUT_EXPIRED);
+            glDeleteSync(delta.fences[delta.frame]);
+            delta.fences[delta.frame] = NULL;
+        }
+        text_data = delta.map + delta.frame * MAX_CON_CHARS;
+    } else {
+        glBufferData(GL_ARRAY_BUFFER, text_char_count * sizeof(vec4_t), text_data, GL_STREAM_DRAW);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, text_char_count);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
 
     text_char_count = 0;
+
+    if(++ui_frame % UI_RUN_MAX_AGE == 0)
+        evict_unused_runs();
 }
 
 int ui_charwidth(ubyte c)
@@ -261,7 +627,6 @@ bool ui_drawchar(float x, float y, ubyte character, int color)
 void ui_drawtext(float x, float y, char *text)
 {
     byte color = 0xf;
-    bool read_color_code = false;
     bool invisible = false;
 
     if(y == -LINE_HEIGHT_PX || y >= ui_h)
@@ -274,39 +639,8 @@ void ui_drawtext(float x, float y, char *text)
     }
 
     while(*text) {
-        if(read_color_code) {
-            switch(*text) {
-                case 'i': {
-                    invisible = true;
-                    read_color_code = false;
-                    text++;
-                    continue;
-                } break;
-                case 'p': {
-                    read_color_code = false;
-                    text++;
-                    x += strtol(text, &text, 10);
-                    continue;
-                } break;
-            }
-
-            if(isdigit(*text))
-                color = *text - '0'; // convert to decimal
-            else if(*text >= 'a' && *text <= 'f')
-                color = *text - 'a' + 0xa; // convert to hex
-            else
-                color = 0x0; // black
-
-            if(color < 0x0 || color > 0xf)
-                color = 0xf;
-
-            invisible = false;
-            read_color_code = false;
-            text++;
-            continue;
-        } else if(*text == CON_STYLE_PREFIX_CHAR) {
-            read_color_code = true;
-            text++;
+        if(*text == CON_STYLE_PREFIX_CHAR) {
+            text = read_style_code(text + 1, &color, &invisible, &x);
             continue;
         }
 
@@ -20,6 +20,19 @@ void ui_printf(float x, float y, const char *fmt, ...);
 int ui_charwidth(ubyte c);
 int ui_strwidth(const char *text);
 
+/* retained text: a string is laid out once (wrapped at wrap_width if that is > 0) and its glyphs
+ * stay on the gpu until the text or the ui size changes. meant for console lines and labels,
+ * anything that changes every frame (numbers) should go through ui_printf instead.
+ * runs that go unused for a while are dropped, so don't hold on to them across frames */
+typedef struct ui_run ui_run;
+const ui_run *ui_get_run(const char *text, int wrap_width);
+int ui_run_rows(const ui_run *run);
+int ui_run_width(const ui_run *run);
+// y is the top of first_row
+void ui_drawrun(float x, float y, const ui_run *run, int first_row, int num_rows);
+// ui_drawrun of a whole unwrapped run, returns its width
+int ui_drawstatic(float x, float y, const char *text);
+
 // console.c
 void ui_draw_console(void);
 
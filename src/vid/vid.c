@@ -72,20 +72,39 @@ static uint32_t check_program_compile(uint32_t h, uint32_t h_vs, uint32_t h_fs)
     return h;
 }
 
-static uint32_t load_shader(const char *vs, const char *fs)
+static void shader_source_with_defines(uint32_t h, const char *src, const char *defines)
+{
+    /* the #version line has to stay first, so the defines go right after it */
+    const char *body = strchr(src, '\n');
+    const char *strings[3];
+    GLint lengths[3];
+
+    body = body ? body + 1 : src;
+
+    strings[0] = src;
+    lengths[0] = (GLint) (body - src);
+    strings[1] = defines;
+    lengths[1] = (GLint) strlen(defines);
+    strings[2] = body;
+    lengths[2] = (GLint) strlen(body);
+
+    glShaderSource(h, 3, strings, lengths);
+}
+
+static uint32_t load_shader_ex(const char *vs, const char *fs, const char *defines)
 {
     uint32_t h_vs, h_fs, h_prog;
 
     // vertex shader
     h_vs = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(h_vs, 1, &vs, NULL);
+    shader_source_with_defines(h_vs, vs, defines);
     glCompileShader(h_vs);
     if(!check_shader_compile(h_vs))
         return 0;
 
     // fragment shader
     h_fs = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(h_fs, 1, &fs, NULL);
+    shader_source_with_defines(h_fs, fs, defines);
     glCompileShader(h_fs);
     if(!check_shader_compile(h_fs))
         return 0;
@@ -97,6 +116,11 @@ static uint32_t load_shader(const char *vs, const char *fs)
     return check_program_compile(h_prog, h_vs, h_fs);
 }
 
+static uint32_t load_shader(const char *vs, const char *fs)
+{
+    return load_shader_ex(vs, fs, "");
+}
+
 // TODO: make this nicer
 void gl_debug_message(GLenum source attr(unused), GLenum type,
                       GLuint id attr(unused), GLenum severity,
@@ -154,9 +178,15 @@ errcode vid_init(void)
 
     /* load shaders */
     gl.shader_blocks_simple = load_shader(simpleblocks_v_glsl, simpleblocks_f_glsl);
-    gl.shader_blocks_complex = load_shader(complexblocks_v_glsl, complexblocks_f_glsl);
+    gl.shader_blocks_complex[RENDER_PASS_OPAQUE] = load_shader_ex(complexblocks_v_glsl, complexblocks_f_glsl,
+                                                                  "#define PASS_OPAQUE\n");
+    gl.shader_blocks_complex[RENDER_PASS_CUTOUT] = load_shader_ex(complexblocks_v_glsl, complexblocks_f_glsl,
+                                                                  "#define PASS_CUTOUT\n");
+    gl.shader_blocks_complex[RENDER_PASS_TRANSLUCENT] = load_shader_ex(complexblocks_v_glsl, complexblocks_f_glsl,
+                                                                       "#define PASS_TRANSLUCENT\n");
     gl.shader_model = load_shader(model_v_glsl, model_f_glsl);
     gl.shader_text = load_shader(text_v_glsl, text_f_glsl);
+    gl.shader_lod = load_shader(lod_v_glsl, lod_f_glsl);
 
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_BLEND);
@@ -192,10 +222,12 @@ void vid_shutdown(void)
 {
     world_renderer_shutdown();
 
-    glDeleteProgram(gl.shader_blocks_complex);
+    for(int i = 0; i < RENDER_PASS_COUNT; i++)
+        glDeleteProgram(gl.shader_blocks_complex[i]);
     glDeleteProgram(gl.shader_blocks_simple);
     glDeleteProgram(gl.shader_text);
     glDeleteProgram(gl.shader_model);
+    glDeleteProgram(gl.shader_lod);
     
     SDL_GL_DeleteContext(glcontext);
     SDL_DestroyWindow(window_handle);
@@ -6,7 +6,9 @@
 
 struct gl_state {
     int w, h;
-    uint32_t shader_blocks_simple, shader_blocks_complex, shader_text, shader_model;
+    uint32_t shader_blocks_simple, shader_text, shader_model, shader_lod;
+    /* same shader with different defines for each render pass */
+    uint32_t shader_blocks_complex[RENDER_PASS_COUNT];
 };
 
 errcode vid_init(void);
@@ -20,4 +22,7 @@ void vid_unlock_fps(void);
 
 void vid_display_frame(void);
 
+// forgets the far terrain of the last game, the world itself is cleared by world_cleanup
+void lod_renderer_clear(void);
+
 #endif
@@ -8,6 +8,16 @@
 #include "meshbuilder.h"
 #include "assets.h"
 #include "client/cvar.h"
+#include "client/console.h"
+#include "gpu_heap.h"
+#include "occlusion.h"
+#include "mesh_cache.h"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#endif
 
 // todo: mesher thread
 
@@ -15,12 +25,95 @@ mat4_t view_mat = {0};
 mat4_t proj_mat = {0};
 static uint32_t gl_world_vao_simple, gl_world_vao_complex;
 static uint32_t gl_world_texture; // fixme
+
+// one layer per tile of terrain.png, the texture index of a vertex is its layer
+#define TERRAIN_LAYERS 256
 static uint32_t gl_block_selection_vbo;
 static GLint loc_chunkpos, loc_proj, loc_view, loc_nightlightmod;
-static GLint loc_chunkpos2, loc_proj2, loc_view2, loc_nightlightmod2, loc_lighttex, loc_terraintex;
+static struct {
+    GLint proj, view, nightlightmod, lighttex, terraintex, grassside, grassoverlay, detaildist;
+} loc_complex[RENDER_PASS_COUNT];
+
+/* all complex chunk meshes are sub-allocated from here so that a whole pass can be drawn with one call */
+static gpu_heap simple_heap, complex_heap;
+
+/* the heap is only compacted on frames without remeshes, a few chunks at a time */
+#define DEFRAG_MIN_FRAGMENTATION 0.25f
+#define DEFRAG_MOVES_PER_FRAME 16
+
+/* every chunk owns a slot, which is its index in the chunk info ssbo and its area in the light
+ * atlas. the vertex shader gets the slot through the base instance of the draw command, the
+ * fragment shader looks the light of each face up in the atlas.
+ * slot 0 is reserved for things that are not chunks (block selection box) */
+#define LIGHT_SLOT_W 18
+#define LIGHT_SLOT_H 18
+#define LIGHT_SLOT_D 128
+#define SELECTION_BOX_SLOT 0
+
+static struct {
+    /* same layout as in complexblocks.v.glsl */
+    struct chunk_info {
+        int32_t origin[4];
+        int32_t light_ofs[4];
+    } *infos;
+    int *free_slots;
+    int num_free, next, capacity;
+    int slots_per_side, max_slots_per_side;
+    uint32_t ssbo, draw_id_vbo, light_atlas;
+} slots;
+
+static struct {
+    struct draw_cmd {
+        GLuint count;
+        GLuint instance_count;
+        GLuint first;
+        GLuint base_instance;
+    } *cmds;
+    size_t count, capacity;
+    size_t pass_start[RENDER_PASS_COUNT], pass_count[RENDER_PASS_COUNT];
+    uint32_t buffer;
+} indirect;
 
 static int num_remeshed = 0;
 
+/* light that changed without the blocks changing is uploaded again for this many chunks per frame */
+#define LIGHT_UPLOADS_PER_FRAME 8
+static int num_light_uploads = 0;
+
+/* sections further than r_detail_distance from the camera are meshed without the small stuff:
+ * plants are skipped, leaves become opaque cubes and redstone dust doesn't look for connections.
+ * the margin keeps a section at the edge from being remeshed back and forth */
+#define DETAIL_MARGIN 8.0f
+static bool mesh_far_section;
+
+/* the render types whose geometry only depends on the block itself are built once per (id, metadata)
+ * at the origin (see build_templates). meshing copies them into place, so torches, plants and rails
+ * cost a memcpy instead of the math below */
+static struct {
+    struct vert_complex *verts;
+    size_t count, capacity;
+    uint32_t first[256 * 16];
+    uint16_t num[256 * 16];
+    bool built;
+} templates;
+
+#define SECTION_BUCKET(pass, section) ((pass) * WORLD_CHUNK_SECTIONS + (section))
+#define ALL_FACES_CONNECTED ((1ull << 36) - 1)
+
+/* only the nearest occluders are drawn into the software depth buffer */
+#define MAX_OCCLUDERS 512
+static vec3_t cam_pos;
+
+/* chunks sorted by distance to the camera, nearest first */
+static struct {
+    struct draw_list_entry {
+        world_chunk *chunk;
+        float dist;
+    } *entries;
+    size_t count, capacity;
+    size_t map_version;
+} draw_list = {.map_version = (size_t) -1};
+
 struct {
     struct plane {
         vec3_t normal;
@@ -28,6 +121,15 @@ struct {
     } top, bottom, right, left, far, near;
 } frustum = {0};
 
+/* minimum corners of every section of every chunk in the draw list, as a structure of arrays
+ * so that several boxes can be tested against a plane at once. sections are always 16x16x16,
+ * so the maximum corner is implied. rebuilt together with the draw list */
+static struct {
+    float *x, *y, *z;
+    ubyte *inside;
+    size_t count, capacity;
+} section_bounds;
+
 extern struct gl_state gl;
 
 struct vert_simple makevert_simple(int x, int y, int z, ubyte texture_index, ubyte light, block_face face)
@@ -41,13 +143,13 @@ struct vert_simple makevert_simple(int x, int y, int z, ubyte texture_index, uby
     return v;
 }
 
-struct vert_complex makevert_complex(vec3_t pos, vec2_t uv, ubyte texture_index, block_face face, ubyte light)
+struct vert_complex makevert_complex(vec3_t pos, vec2_t uv, ubyte texture_index, block_face face)
 {
     struct vert_complex v = {0};
     v.pos = pos;
     v.uv = uv;
     v.texture_index = texture_index;
-    v.data = face | (light << 3);
+    v.data = face;
     v.r = 0xff;
     v.g = 0xff;
     v.b = 0xff;
@@ -65,19 +167,19 @@ struct vert_complex *update_block_selection_box(bbox_t box)
     float y1 = box.maxs.y + grow;
     float z1 = box.maxs.z + grow;
 
-    b[0] = makevert_complex(vec3(x0, y0, z0), vec2(0, 0), 0, 0, 0);
-    b[1] = makevert_complex(vec3(x1, y0, z0), vec2(0, 0), 0, 0, 0);
-    b[2] = makevert_complex(vec3(x1, y0, z1), vec2(0, 0), 0, 0, 0);
-    b[3] = makevert_complex(vec3(x0, y0, z1), vec2(0, 0), 0, 0, 0);
+    b[0] = makevert_complex(vec3(x0, y0, z0), vec2(0, 0), 0, 0);
+    b[1] = makevert_complex(vec3(x1, y0, z0), vec2(0, 0), 0, 0);
+    b[2] = makevert_complex(vec3(x1, y0, z1), vec2(0, 0), 0, 0);
+    b[3] = makevert_complex(vec3(x0, y0, z1), vec2(0, 0), 0, 0);
     b[4] = b[0];
-    b[5] = makevert_complex(vec3(x0, y1, z0), vec2(0, 0), 0, 0, 0);
-    b[6] = makevert_complex(vec3(x1, y1, z0), vec2(0, 0), 0, 0, 0);
+    b[5] = makevert_complex(vec3(x0, y1, z0), vec2(0, 0), 0, 0);
+    b[6] = makevert_complex(vec3(x1, y1, z0), vec2(0, 0), 0, 0);
     b[7] = b[1];
     b[8] = b[6];
-    b[9] = makevert_complex(vec3(x1, y1, z1), vec2(0, 0), 0, 0, 0);
+    b[9] = makevert_complex(vec3(x1, y1, z1), vec2(0, 0), 0, 0);
     b[10] = b[2];
     b[11] = b[9];
-    b[12] = makevert_complex(vec3(x0, y1, z1), vec2(0, 0), 0, 0, 0);
+    b[12] = makevert_complex(vec3(x0, y1, z1), vec2(0, 0), 0, 0);
     b[13] = b[3];
     b[14] = b[12];
     b[15] = b[5];
@@ -101,19 +203,6 @@ static struct plane make_plane(vec3_t point, vec3_t normal)
     return p;
 }
 
-static bool is_visible_on_frustum(vec3_t point, float radius)
-{
-    return
-            get_dist_to_plane(&frustum.right, point) > -radius &&
-            get_dist_to_plane(&frustum.left, point) > -radius &&
-            get_dist_to_plane(&frustum.bottom, point) > -radius &&
-            get_dist_to_plane(&frustum.top, point) > -radius &&
-            get_dist_to_plane(&frustum.far, point) > -radius &&
-            get_dist_to_plane(&frustum.near, point) > -radius;
-}
-
-void world_renderer_update_chunk_visibility(world_chunk *chunk);
-
 static void update_view_matrix_and_frustum(void)
 {
     float half_h = r_zfar.value * tanf(deg2rad(fov.value) * 0.5f);
@@ -123,7 +212,7 @@ static void update_view_matrix_and_frustum(void)
     vec3_t tmp;
 
     static float accumulated_dt = 0.0f;
-    static vec3_t lerp_pos;
+    vec3_t lerp_pos;
 
     if(cl.is_physframe)
         accumulated_dt = 0.0f;
@@ -133,6 +222,7 @@ static void update_view_matrix_and_frustum(void)
 
     if(cl_freecamera.integer)
         lerp_pos = cl.game.cam_pos;
+    cam_pos = lerp_pos;
 
     cam_angles(&forward, &right, &up, cl.game.our_ent->rotation.yaw, cl.game.our_ent->rotation.pitch);
     fwdFar = vec3_mul(forward, r_zfar.value);
@@ -154,7 +244,7 @@ static void update_view_matrix_and_frustum(void)
     mat4_view(view_mat, lerp_pos, cl.game.our_ent->rotation);
 
     /* update look trace and selection box */
-    if(cl.state == cl_connected) {
+    if(cl.state >= cl_connected) {
         struct vert_complex *selection_box;
         bbox_t bbox;
 
@@ -170,28 +260,186 @@ static void update_view_matrix_and_frustum(void)
                 /* usage */ GL_STATIC_DRAW);
         glBindBuffer(GL_ARRAY_BUFFER, 0);
     }
-
-    /* update visibility of chunks */
-    if(world_chunk_map != NULL && hashmap_count(world_chunk_map) > 0) {
-        size_t i = 0;
-        void *it;
-        while(hashmap_iter(world_chunk_map, &i, &it)) {
-            world_chunk *chunk = (world_chunk *) it;
-            world_renderer_update_chunk_visibility(chunk);
-        }
-    }
 }
 
 void recalculate_projection_matrix(void)
 {
+    static float last_fov, last_aspect, last_znear, last_zfar;
     float aspect = (vid_width.value / vid_height.value);
+
+    /* this gets called for every resize and cvar change, even if nothing actually changed */
+    if(fov.value == last_fov && aspect == last_aspect && r_znear.value == last_znear && r_zfar.value == last_zfar)
+        return;
+
+    last_fov = fov.value;
+    last_aspect = aspect;
+    last_znear = r_znear.value;
+    last_zfar = r_zfar.value;
+
     mat4_projection(proj_mat, fov.value, aspect, r_znear.value, r_zfar.value);
     update_view_matrix_and_frustum();
 }
 
+static void slots_resize(int slots_per_side)
+{
+    int capacity = slots_per_side * slots_per_side;
+    uint32_t new_atlas;
+    GLuint *draw_ids;
+
+    glGenTextures(1, &new_atlas);
+    glBindTexture(GL_TEXTURE_3D, new_atlas);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_R8UI, slots_per_side * LIGHT_SLOT_W, slots_per_side * LIGHT_SLOT_H,
+                 LIGHT_SLOT_D, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, NULL);
+    glBindTexture(GL_TEXTURE_3D, 0);
+
+    slots.infos = realloc(slots.infos, capacity * sizeof(*slots.infos));
+    slots.free_slots = realloc(slots.free_slots, capacity * sizeof(*slots.free_slots));
+
+    /* the slot layout depends on the atlas size, so every slot moves */
+    for(int i = 0; i < capacity; i++) {
+        int x = (i % slots_per_side) * LIGHT_SLOT_W;
+        int y = (i / slots_per_side) * LIGHT_SLOT_H;
+
+        if(i < slots.capacity) {
+            glCopyImageSubData(slots.light_atlas, GL_TEXTURE_3D, 0,
+                               slots.infos[i].light_ofs[0], slots.infos[i].light_ofs[1], 0,
+                               new_atlas, GL_TEXTURE_3D, 0, x, y, 0,
+                               LIGHT_SLOT_W, LIGHT_SLOT_H, LIGHT_SLOT_D);
+        } else {
+            memset(&slots.infos[i], 0, sizeof(slots.infos[i]));
+        }
+
+        slots.infos[i].light_ofs[0] = x;
+        slots.infos[i].light_ofs[1] = y;
+    }
+
+    glDeleteTextures(1, &slots.light_atlas);
+    slots.light_atlas = new_atlas;
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, slots.ssbo);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(*slots.infos), slots.infos, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    /* draw id n is just n, so the attribute ends up being the base instance */
+    draw_ids = mem_alloc(capacity * sizeof(*draw_ids));
+    for(int i = 0; i < capacity; i++)
+        draw_ids[i] = i;
+    glBindBuffer(GL_ARRAY_BUFFER, slots.draw_id_vbo);
+    glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(*draw_ids), draw_ids, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    mem_free(draw_ids);
+
+    slots.slots_per_side = slots_per_side;
+    slots.capacity = capacity;
+}
+
+static void slots_init(void)
+{
+    GLint max_size;
+
+    glGetIntegerv(GL_MAX_3D_TEXTURE_SIZE, &max_size);
+    slots.max_slots_per_side = max_size / max(LIGHT_SLOT_W, LIGHT_SLOT_H);
+
+    glGenBuffers(1, &slots.ssbo);
+    glGenBuffers(1, &slots.draw_id_vbo);
+    slots_resize(16);
+
+    slots.next = SELECTION_BOX_SLOT + 1;
+}
+
+static int slot_alloc(void)
+{
+    if(slots.num_free > 0)
+        return slots.free_slots[--slots.num_free];
+
+    if(slots.next == slots.capacity) {
+        if(slots.slots_per_side * 2 > slots.max_slots_per_side) {
+            con_printf("out of light atlas slots, chunk won't be drawn\n");
+            return -1;
+        }
+        slots_resize(slots.slots_per_side * 2);
+    }
+
+    return slots.next++;
+}
+
+static void slot_free(int slot)
+{
+    if(slot > 0)
+        slots.free_slots[slots.num_free++] = slot;
+}
+
+static void slot_set_chunk(int slot, world_chunk *chunk)
+{
+    struct chunk_info *info = &slots.infos[slot];
+
+    info->origin[0] = chunk->x << 4;
+    info->origin[1] = 0;
+    info->origin[2] = chunk->z << 4;
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, slots.ssbo);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, slot * sizeof(*info), sizeof(*info), info);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+static void upload_chunk_light(world_chunk *chunk)
+{
+    ubyte data[LIGHT_SLOT_D][LIGHT_SLOT_H][LIGHT_SLOT_W]; // D H W
+    struct chunk_info *info;
+
+    if(chunk->gl.slot < 0)
+        return;
+
+    info = &slots.infos[chunk->gl.slot];
+
+    for(int w = 0; w < LIGHT_SLOT_W; w++) {
+        for(int h = 0; h < LIGHT_SLOT_H; h++) {
+            for(int d = 0; d < LIGHT_SLOT_D; d++) {
+                int x = (chunk->x << 4) + w - 1, z = (chunk->z << 4) + h - 1;
+                /* slabs, stairs and farmland carry no light of their own, they get the brightest neighbour */
+                data[d][h][w] = world_get_block_lighting_fast(world_get_block(x, d, z), x, d, z);
+            }
+        }
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glBindTexture(GL_TEXTURE_3D, slots.light_atlas);
+    glTexSubImage3D(GL_TEXTURE_3D, 0, info->light_ofs[0], info->light_ofs[1], 0,
+                    LIGHT_SLOT_W, LIGHT_SLOT_H, LIGHT_SLOT_D, GL_RED_INTEGER, GL_UNSIGNED_BYTE, data);
+    glBindTexture(GL_TEXTURE_3D, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+static void gl_heapinfo_f(void)
+{
+    size_t slots_used = slots.next - slots.num_free - 1;
+    size_t atlas_size = (size_t) slots.capacity * LIGHT_SLOT_W * LIGHT_SLOT_H * LIGHT_SLOT_D;
+    size_t heap_size = complex_heap.capacity * complex_heap.elem_size;
+    size_t simple_heap_size = simple_heap.capacity * simple_heap.elem_size;
+    size_t staging_size = gpu_heap_is_persistent() ? GPU_HEAP_STAGING_SIZE : 0;
+
+    con_printf("complex vertex heap: %zu / %zu KiB used, %zu free ranges, largest free %zu KiB, %.1f%% fragmented\n",
+               complex_heap.used * complex_heap.elem_size / 1024, heap_size / 1024,
+               complex_heap.num_free_ranges, gpu_heap_largest_free(&complex_heap) * complex_heap.elem_size / 1024,
+               gpu_heap_fragmentation(&complex_heap) * 100.0f);
+    con_printf("simple vertex heap: %zu / %zu KiB used\n",
+               simple_heap.used * simple_heap.elem_size / 1024, simple_heap_size / 1024);
+    con_printf("light atlas: %zu / %d slots, %zu KiB\n", slots_used, slots.capacity - 1, atlas_size / 1024);
+    con_printf("chunk info: %zu KiB\n", slots.capacity * sizeof(*slots.infos) / 1024);
+    if(gpu_heap_is_persistent())
+        con_printf("staging: persistently mapped, %zu KiB\n", staging_size / 1024);
+    else
+        con_printf("staging: none, uploads use glBufferSubData\n");
+    con_printf("total: %zu KiB\n", (heap_size + simple_heap_size + atlas_size + staging_size + slots.capacity * sizeof(*slots.infos)) / 1024);
+}
+
 void world_renderer_init(void)
 {
     asset_image *terrain_asset;
+    int tile_w, tile_h, levels;
 
     recalculate_projection_matrix();
 
@@ -200,17 +448,23 @@ void world_renderer_init(void)
     loc_proj = glGetUniformLocation(gl.shader_blocks_simple, "PROJECTION");
     loc_nightlightmod = glGetUniformLocation(gl.shader_blocks_simple, "NIGHTTIME_LIGHT_MODIFIER");
 
-    loc_chunkpos2 = glGetUniformLocation(gl.shader_blocks_complex, "CHUNK_POS");
-    loc_view2 = glGetUniformLocation(gl.shader_blocks_complex, "VIEW");
-    loc_proj2 = glGetUniformLocation(gl.shader_blocks_complex, "PROJECTION");
-    loc_nightlightmod2 = glGetUniformLocation(gl.shader_blocks_complex, "NIGHTTIME_LIGHT_MODIFIER");
-    loc_lighttex = glGetUniformLocation(gl.shader_blocks_complex, "LIGHT_TEX");
-    loc_terraintex = glGetUniformLocation(gl.shader_blocks_complex, "TEXTURE");
+    for(int pass = 0; pass < RENDER_PASS_COUNT; pass++) {
+        uint32_t shader = gl.shader_blocks_complex[pass];
+        loc_complex[pass].view = glGetUniformLocation(shader, "VIEW");
+        loc_complex[pass].proj = glGetUniformLocation(shader, "PROJECTION");
+        loc_complex[pass].nightlightmod = glGetUniformLocation(shader, "NIGHTTIME_LIGHT_MODIFIER");
+        loc_complex[pass].lighttex = glGetUniformLocation(shader, "LIGHT_TEX");
+        loc_complex[pass].terraintex = glGetUniformLocation(shader, "TEXTURE");
+        loc_complex[pass].grassside = glGetUniformLocation(shader, "GRASS_SIDE_LAYER");
+        loc_complex[pass].grassoverlay = glGetUniformLocation(shader, "GRASS_OVERLAY_LAYER");
+        loc_complex[pass].detaildist = glGetUniformLocation(shader, "DETAIL_DISTANCE");
+    }
 
     /* init vaos */
     glGenVertexArrays(1, &gl_world_vao_simple);
     glGenVertexArrays(1, &gl_world_vao_complex);
 
+    /* the heaps replace their buffers when they grow, so those get bound when drawing */
     glBindVertexArray(gl_world_vao_simple);
     glVertexAttribIFormat(0, 1, GL_UNSIGNED_SHORT, 0); // x,y,z, 1 bit padding
     glVertexAttribIFormat(1, 1, GL_UNSIGNED_SHORT, 2);  // texture index and data
@@ -229,32 +483,85 @@ void world_renderer_init(void)
     glVertexAttribBinding(1, 0);
     glVertexAttribBinding(2, 0);
     glVertexAttribBinding(3, 0);
+    glVertexAttribIFormat(4, 1, GL_UNSIGNED_INT, 0); // draw id (chunk slot), comes from the base instance
+    glVertexAttribBinding(4, 1);
+    glVertexBindingDivisor(1, 1);
     glEnableVertexAttribArray(0);
     glEnableVertexAttribArray(1);
     glEnableVertexAttribArray(2);
     glEnableVertexAttribArray(3);
+    glEnableVertexAttribArray(4);
     glBindVertexArray(0);
 
-    /* load terrain texture */
+    gpu_heap_init(&simple_heap, sizeof(struct vert_simple), 1 << 16);
+    gpu_heap_init(&complex_heap, sizeof(struct vert_complex), 1 << 20);
+    glGenBuffers(1, &indirect.buffer);
+    slots_init();
+
+    cmd_register("gl_heapinfo", gl_heapinfo_f);
+
+    lod_renderer_init();
+
+    /* load terrain texture. every 16x16 tile of the atlas becomes a layer of its own, so that its
+     * mipmaps are made of nothing but the tile and sampling never bleeds into the neighbours */
     terrain_asset = asset_get_image(ASSET_TEXTURE_TERRAIN);
+    tile_w = terrain_asset->width / 16;
+    tile_h = terrain_asset->height / 16;
+    for(levels = 1; (tile_w >> levels) > 0 && (tile_h >> levels) > 0; levels++)
+        ;
 
     glGenTextures(1, &gl_world_texture);
-    glBindTexture(GL_TEXTURE_2D, gl_world_texture);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, terrain_asset->width, terrain_asset->height, 0, GL_RGBA, GL_UNSIGNED_BYTE,
-                 terrain_asset->data);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, gl_world_texture);
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, GL_RGBA8, tile_w, tile_h, TERRAIN_LAYERS);
+
+    /* the tiles are picked straight out of the atlas image */
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, terrain_asset->width);
+    for(int layer = 0; layer < TERRAIN_LAYERS; layer++) {
+        glPixelStorei(GL_UNPACK_SKIP_PIXELS, (layer % 16) * tile_w);
+        glPixelStorei(GL_UNPACK_SKIP_ROWS, (layer / 16) * tile_h);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, tile_w, tile_h, 1, GL_RGBA, GL_UNSIGNED_BYTE,
+                        terrain_asset->data);
+    }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+    glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
 
-    glBindTexture(GL_TEXTURE_2D, 0);
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
 
     glGenBuffers(1, &gl_block_selection_vbo);
 }
 
 void world_renderer_shutdown(void)
 {
+    mem_free(draw_list.entries);
+    mem_free(section_bounds.x);
+    mem_free(section_bounds.y);
+    mem_free(section_bounds.z);
+    mem_free(section_bounds.inside);
+    mem_free(indirect.cmds);
+    glDeleteBuffers(1, &indirect.buffer);
+    gpu_heap_shutdown(&simple_heap);
+    gpu_heap_shutdown(&complex_heap);
+    lod_renderer_shutdown();
+    gpu_heap_staging_shutdown();
+    mesh_cache_shutdown();
+
+    glDeleteBuffers(1, &slots.ssbo);
+    glDeleteBuffers(1, &slots.draw_id_vbo);
+    glDeleteTextures(1, &slots.light_atlas);
+    mem_free(slots.infos);
+    mem_free(slots.free_slots);
+
+    glDeleteTextures(1, &gl_world_texture);
+
+    mem_free(templates.verts);
+    memset(&templates, 0, sizeof(templates));
 }
 
 static void add_block_face(struct vert_complex v, block_face face)
@@ -298,7 +605,7 @@ static void add_block_face(struct vert_complex v, block_face face)
     meshbuilder_add_quad(&tl, &tr, &bl, &br);
 }
 
-static void add_bottom_face(vec3_t v0, vec3_t v1, vec2_t uv0, vec2_t uv1, int texture, ubyte light)
+static void add_bottom_face(vec3_t v0, vec3_t v1, vec2_t uv0, vec2_t uv1, int texture)
 {
     struct vert_complex tl, tr, bl, br;
 
@@ -307,15 +614,15 @@ static void add_bottom_face(vec3_t v0, vec3_t v1, vec2_t uv0, vec2_t uv1, int te
         texture = -texture;
     }
 
-    tl = makevert_complex(vec3(v0.x, v0.y, v0.z), vec2(uv0.u, uv1.v), texture, BLOCK_FACE_Y_NEG, light);
-    tr = makevert_complex(vec3(v0.x, v0.y, v1.z), vec2(uv0.u, uv0.v), texture, BLOCK_FACE_Y_NEG, light);
-    bl = makevert_complex(vec3(v1.x, v0.y, v0.z), vec2(uv1.u, uv1.v), texture, BLOCK_FACE_Y_NEG, light);
-    br = makevert_complex(vec3(v1.x, v0.y, v1.z), vec2(uv1.u, uv0.v), texture, BLOCK_FACE_Y_NEG, light);
+    tl = makevert_complex(vec3(v0.x, v0.y, v0.z), vec2(uv0.u, uv1.v), texture, BLOCK_FACE_Y_NEG);
+    tr = makevert_complex(vec3(v0.x, v0.y, v1.z), vec2(uv0.u, uv0.v), texture, BLOCK_FACE_Y_NEG);
+    bl = makevert_complex(vec3(v1.x, v0.y, v0.z), vec2(uv1.u, uv1.v), texture, BLOCK_FACE_Y_NEG);
+    br = makevert_complex(vec3(v1.x, v0.y, v1.z), vec2(uv1.u, uv0.v), texture, BLOCK_FACE_Y_NEG);
 
     meshbuilder_add_quad(&tl, &tr, &bl, &br);
 }
 
-static void add_top_face(vec3_t v0, vec3_t v1, vec2_t uv0, vec2_t uv1, int texture, ubyte light)
+static void add_top_face(vec3_t v0, vec3_t v1, vec2_t uv0, vec2_t uv1, int texture)
 {
     struct vert_complex tl, tr, bl, br;
 
@@ -324,15 +631,15 @@ static void add_top_face(vec3_t v0, vec3_t v1, vec2_t uv0, vec2_t uv1, int textu
         texture = -texture;
     }
 
-    tl = makevert_complex(vec3(v0.x, v1.y, v0.z), vec2(uv0.u, uv0.v), texture, BLOCK_FACE_Y_POS, light);
-    tr = makevert_complex(vec3(v1.x, v1.y, v0.z), vec2(uv1.u, uv0.v), texture, BLOCK_FACE_Y_POS, light);
-    bl = makevert_complex(vec3(v0.x, v1.y, v1.z), vec2(uv0.u, uv1.v), texture, BLOCK_FACE_Y_POS, light);
-    br = makevert_complex(vec3(v1.x, v1.y, v1.z), vec2(uv1.u, uv1.v), texture, BLOCK_FACE_Y_POS, light);
+    tl = makevert_complex(vec3(v0.x, v1.y, v0.z), vec2(uv0.u, uv0.v), texture, BLOCK_FACE_Y_POS);
+    tr = makevert_complex(vec3(v1.x, v1.y, v0.z), vec2(uv1.u, uv0.v), texture, BLOCK_FACE_Y_POS);
+    bl = makevert_complex(vec3(v0.x, v1.y, v1.z), vec2(uv0.u, uv1.v), texture, BLOCK_FACE_Y_POS);
+    br = makevert_complex(vec3(v1.x, v1.y, v1.z), vec2(uv1.u, uv1.v), texture, BLOCK_FACE_Y_POS);
 
     meshbuilder_add_quad(&tl, &tr, &bl, &br);
 }
 
-static void add_north_face(vec3_t v0, vec3_t v1, vec2_t uv0, vec2_t uv1, int texture, ubyte light)
+static void add_north_face(vec3_t v0, vec3_t v1, vec2_t uv0, vec2_t uv1, int texture)
 {
     struct vert_complex tl, tr, bl, br;
 
@@ -341,15 +648,15 @@ static void add_north_face(vec3_t v0, vec3_t v1, vec2_t uv0, vec2_t uv1, int tex
         texture = -texture;
     }
 
-    tl = makevert_complex(vec3(v1.x, v1.y, v0.z), vec2(uv0.u, uv0.v), texture, BLOCK_FACE_Z_NEG, light);
-    tr = makevert_complex(vec3(v0.x, v1.y, v0.z), vec2(uv1.u, uv0.v), texture, BLOCK_FACE_Z_NEG, light);
-    bl = makevert_complex(vec3(v1.x, v0.y, v0.z), vec2(uv0.u, uv1.v), texture, BLOCK_FACE_Z_NEG, light);
-    br = makevert_complex(vec3(v0.x, v0.y, v0.z), vec2(uv1.u, uv1.v), texture, BLOCK_FACE_Z_NEG, light);
+    tl = makevert_complex(vec3(v1.x, v1.y, v0.z), vec2(uv0.u, uv0.v), texture, BLOCK_FACE_Z_NEG);
+    tr = makevert_complex(vec3(v0.x, v1.y, v0.z), vec2(uv1.u, uv0.v), texture, BLOCK_FACE_Z_NEG);
+    bl = makevert_complex(vec3(v1.x, v0.y, v0.z), vec2(uv0.u, uv1.v), texture, BLOCK_FACE_Z_NEG);
+    br = makevert_complex(vec3(v0.x, v0.y, v0.z), vec2(uv1.u, uv1.v), texture, BLOCK_FACE_Z_NEG);
 
     meshbuilder_add_quad(&tl, &tr, &bl, &br);
 }
 
-static void add_south_face(vec3_t v0, vec3_t v1, vec2_t uv0, vec2_t uv1, int texture, ubyte light)
+static void add_south_face(vec3_t v0, vec3_t v1, vec2_t uv0, vec2_t uv1, int texture)
 {
     struct vert_complex tl, tr, bl, br;
 
@@ -358,15 +665,15 @@ static void add_south_face(vec3_t v0, vec3_t v1, vec2_t uv0, vec2_t uv1, int tex
         texture = -texture;
     }
 
-    tl = makevert_complex(vec3(v1.x, v0.y, v1.z), vec2(uv1.u, uv1.v), texture, BLOCK_FACE_Z_POS, light);
-    tr = makevert_complex(vec3(v0.x, v0.y, v1.z), vec2(uv0.u, uv1.v), texture, BLOCK_FACE_Z_POS, light);
-    bl = makevert_complex(vec3(v1.x, v1.y, v1.z), vec2(uv1.u, uv0.v), texture, BLOCK_FACE_Z_POS, light);
-    br = makevert_complex(vec3(v0.x, v1.y, v1.z), vec2(uv0.u, uv0.v), texture, BLOCK_FACE_Z_POS, light);
+    tl = makevert_complex(vec3(v1.x, v0.y, v1.z), vec2(uv1.u, uv1.v), texture, BLOCK_FACE_Z_POS);
+    tr = makevert_complex(vec3(v0.x, v0.y, v1.z), vec2(uv0.u, uv1.v), texture, BLOCK_FACE_Z_POS);
+    bl = makevert_complex(vec3(v1.x, v1.y, v1.z), vec2(uv1.u, uv0.v), texture, BLOCK_FACE_Z_POS);
+    br = makevert_complex(vec3(v0.x, v1.y, v1.z), vec2(uv0.u, uv0.v), texture, BLOCK_FACE_Z_POS);
 
     meshbuilder_add_quad(&tl, &tr, &bl, &br);
 }
 
-static void add_west_face(vec3_t v0, vec3_t v1, vec2_t uv0, vec2_t uv1, int texture, ubyte light)
+static void add_west_face(vec3_t v0, vec3_t v1, vec2_t uv0, vec2_t uv1, int texture)
 {
     struct vert_complex tl, tr, bl, br;
 
@@ -375,15 +682,15 @@ static void add_west_face(vec3_t v0, vec3_t v1, vec2_t uv0, vec2_t uv1, int text
         texture = -texture;
     }
 
-    tl = makevert_complex(vec3(v0.x, v1.y, v0.z), vec2(uv1.u, uv0.v), texture, BLOCK_FACE_X_NEG, light);
-    tr = makevert_complex(vec3(v0.x, v1.y, v1.z), vec2(uv0.u, uv0.v), texture, BLOCK_FACE_X_NEG, light);
-    bl = makevert_complex(vec3(v0.x, v0.y, v0.z), vec2(uv1.u, uv1.v), texture, BLOCK_FACE_X_NEG, light);
-    br = makevert_complex(vec3(v0.x, v0.y, v1.z), vec2(uv0.u, uv1.v), texture, BLOCK_FACE_X_NEG, light);
+    tl = makevert_complex(vec3(v0.x, v1.y, v0.z), vec2(uv1.u, uv0.v), texture, BLOCK_FACE_X_NEG);
+    tr = makevert_complex(vec3(v0.x, v1.y, v1.z), vec2(uv0.u, uv0.v), texture, BLOCK_FACE_X_NEG);
+    bl = makevert_complex(vec3(v0.x, v0.y, v0.z), vec2(uv1.u, uv1.v), texture, BLOCK_FACE_X_NEG);
+    br = makevert_complex(vec3(v0.x, v0.y, v1.z), vec2(uv0.u, uv1.v), texture, BLOCK_FACE_X_NEG);
 
     meshbuilder_add_quad(&tl, &tr, &bl, &br);
 }
 
-static void add_east_face(vec3_t v0, vec3_t v1, vec2_t uv0, vec2_t uv1, int texture, ubyte light)
+static void add_east_face(vec3_t v0, vec3_t v1, vec2_t uv0, vec2_t uv1, int texture)
 {
     struct vert_complex tl, tr, bl, br;
 
@@ -392,10 +699,10 @@ static void add_east_face(vec3_t v0, vec3_t v1, vec2_t uv0, vec2_t uv1, int text
         texture = -texture;
     }
 
-    tl = makevert_complex(vec3(v1.x, v1.y, v1.z), vec2(uv0.u, uv0.v), texture, BLOCK_FACE_X_POS, light);
-    tr = makevert_complex(vec3(v1.x, v1.y, v0.z), vec2(uv1.u, uv0.v), texture, BLOCK_FACE_X_POS, light);
-    bl = makevert_complex(vec3(v1.x, v0.y, v1.z), vec2(uv0.u, uv1.v), texture, BLOCK_FACE_X_POS, light);
-    br = makevert_complex(vec3(v1.x, v0.y, v0.z), vec2(uv1.u, uv1.v), texture, BLOCK_FACE_X_POS, light);
+    tl = makevert_complex(vec3(v1.x, v1.y, v1.z), vec2(uv0.u, uv0.v), texture, BLOCK_FACE_X_POS);
+    tr = makevert_complex(vec3(v1.x, v1.y, v0.z), vec2(uv1.u, uv0.v), texture, BLOCK_FACE_X_POS);
+    bl = makevert_complex(vec3(v1.x, v0.y, v1.z), vec2(uv0.u, uv1.v), texture, BLOCK_FACE_X_POS);
+    br = makevert_complex(vec3(v1.x, v0.y, v0.z), vec2(uv1.u, uv1.v), texture, BLOCK_FACE_X_POS);
 
     meshbuilder_add_quad(&tl, &tr, &bl, &br);
 }
@@ -429,7 +736,6 @@ static void render_box(int x, int y, int z, bbox_t box, block_data self, int f)
     vec3_t vec1 = vec3(x1, y1, z1);
 
     int tex;
-    ubyte light;
 
     if(box.mins.x < 0.0f || box.maxs.x > 1.0f) {
         uv_x0p = 0.0f;
@@ -443,48 +749,72 @@ static void render_box(int x, int y, int z, bbox_t box, block_data self, int f)
 
     if((f & SIDE_YN) && block_should_render_face(x, y, z, self, BLOCK_FACE_Y_NEG)) {
         tex = block_get_texture_index(self.id, BLOCK_FACE_Y_NEG, self.metadata, x, y, z);
-        light = world_get_block_lighting(x, y - 1, z);
-        add_bottom_face(vec0, vec1, vec2(uv_x0p, uv_z0p), vec2(uv_x1p, uv_z1p), tex, light);
+        add_bottom_face(vec0, vec1, vec2(uv_x0p, uv_z0p), vec2(uv_x1p, uv_z1p), tex);
     }
 
     if((f & SIDE_YP) && block_should_render_face(x, y, z, self, BLOCK_FACE_Y_POS)) {
         tex = block_get_texture_index(self.id, BLOCK_FACE_Y_POS, self.metadata, x, y, z);
-        light = world_get_block_lighting(x, y + 1, z);
-        add_top_face(vec0, vec1, vec2(uv_x0p, uv_z0p), vec2(uv_x1p, uv_z1p), tex, light);
+        add_top_face(vec0, vec1, vec2(uv_x0p, uv_z0p), vec2(uv_x1p, uv_z1p), tex);
     }
 
     if((f & SIDE_ZN) && block_should_render_face(x, y, z, self, BLOCK_FACE_Z_NEG)) {
         tex = block_get_texture_index(self.id, BLOCK_FACE_Z_NEG, self.metadata, x, y, z);
-        light = world_get_block_lighting(x, y, z - 1);
-        add_north_face(vec0, vec1, vec2(uv_x0p, uv_y1n), vec2(uv_x1p, uv_y0n), tex, light);
+        add_north_face(vec0, vec1, vec2(uv_x0p, uv_y1n), vec2(uv_x1p, uv_y0n), tex);
     }
 
     if((f & SIDE_ZP) && block_should_render_face(x, y, z, self, BLOCK_FACE_Z_POS)) {
         tex = block_get_texture_index(self.id, BLOCK_FACE_Z_POS, self.metadata, x, y, z);
-        light = world_get_block_lighting(x, y, z + 1);
-        add_south_face(vec0, vec1, vec2(uv_x0p, uv_y1n), vec2(uv_x1p, uv_y0n), tex, light);
+        add_south_face(vec0, vec1, vec2(uv_x0p, uv_y1n), vec2(uv_x1p, uv_y0n), tex);
     }
 
     if((f & SIDE_XN) && block_should_render_face(x, y, z, self, BLOCK_FACE_X_NEG)) {
         tex = block_get_texture_index(self.id, BLOCK_FACE_X_NEG, self.metadata, x, y, z);
-        light = world_get_block_lighting(x - 1, y, z);
-        add_west_face(vec0, vec1, vec2(uv_z1p, uv_y1n), vec2(uv_z0p, uv_y0n), tex, light);
+        add_west_face(vec0, vec1, vec2(uv_z1p, uv_y1n), vec2(uv_z0p, uv_y0n), tex);
     }
 
     if((f & SIDE_XP) && block_should_render_face(x, y, z, self, BLOCK_FACE_X_POS)) {
         tex = block_get_texture_index(self.id, BLOCK_FACE_X_POS, self.metadata, x, y, z);
-        light = world_get_block_lighting(x + 1, y, z);
-        add_east_face(vec0, vec1, vec2(uv_z0p, uv_y1n), vec2(uv_z1p, uv_y0n), tex, light);
+        add_east_face(vec0, vec1, vec2(uv_z0p, uv_y1n), vec2(uv_z1p, uv_y0n), tex);
+    }
+}
+
+/* a fluid corner is shared by up to four fluid blocks and costs up to eight block lookups, so each
+ * corner of the chunk being meshed is computed once. entries are valid while their stamp matches */
+static struct {
+    float height[WORLD_CHUNK_SIZE + 1][WORLD_CHUNK_SIZE + 1][WORLD_CHUNK_HEIGHT];
+    block_id id[WORLD_CHUNK_SIZE + 1][WORLD_CHUNK_SIZE + 1][WORLD_CHUNK_HEIGHT];
+    uint32_t stamp[WORLD_CHUNK_SIZE + 1][WORLD_CHUNK_SIZE + 1][WORLD_CHUNK_HEIGHT];
+    uint32_t current;
+} fluid_corners;
+
+static void fluid_corners_reset(void)
+{
+    if(++fluid_corners.current == 0) {
+        memset(fluid_corners.stamp, 0, sizeof(fluid_corners.stamp));
+        fluid_corners.current = 1;
     }
 }
 
+// height of the corner at the minimum x and z of block (x + dx, y, z + dz)
+static float get_fluid_corner(int x, int y, int z, int dx, int dz, block_id id)
+{
+    int cx = (x & 15) + dx, cz = (z & 15) + dz;
+
+    if(fluid_corners.stamp[cx][cz][y] != fluid_corners.current || fluid_corners.id[cx][cz][y] != id) {
+        fluid_corners.height[cx][cz][y] = block_fluid_get_height(x + dx, y, z + dz, id);
+        fluid_corners.id[cx][cz][y] = id;
+        fluid_corners.stamp[cx][cz][y] = fluid_corners.current;
+    }
+
+    return fluid_corners.height[cx][cz][y];
+}
+
 void render_fluid(int x, int y, int z, block_data self)
 {
     if(block_should_render_face(x, y, z, self, BLOCK_FACE_Y_POS)) {
         float h_00, h_10, h_01, h_11;
-        block_properties props = block_get_properties(self.id);
+        const block_properties *props = block_get_properties(self.id);
         struct vert_complex v1, v2, v3, v4;
-        ubyte light;
         //vec3_t flowdir; todo
         //float flowangle;
 
@@ -495,28 +825,27 @@ void render_fluid(int x, int y, int z, block_data self)
         //	con_printf("%f %f %f -> %f\n", flowdir[0], flowdir[1], flowdir[2], flowangle);
         //}
 
-        h_00 = block_fluid_get_height(x, y, z, self.id);
-        h_10 = block_fluid_get_height(x + 1, y, z, self.id);
-        h_01 = block_fluid_get_height(x, y, z + 1, self.id);
-        h_11 = block_fluid_get_height(x + 1, y, z + 1, self.id);
+        h_00 = get_fluid_corner(x, y, z, 0, 0, self.id);
+        h_10 = get_fluid_corner(x, y, z, 1, 0, self.id);
+        h_01 = get_fluid_corner(x, y, z, 0, 1, self.id);
+        h_11 = get_fluid_corner(x, y, z, 1, 1, self.id);
 
-        light = world_get_block_lighting_fast(self, x, y, z);
         v1 = makevert_complex(
                 vec3((x & 15), (y) + h_00, (z & 15)), vec2(0, 0),
-                props.texture_indices[BLOCK_FACE_Y_POS],
-                BLOCK_FACE_Y_POS, light);
+                props->texture_indices[BLOCK_FACE_Y_POS],
+                BLOCK_FACE_Y_POS);
         v2 = makevert_complex(
                 vec3((x & 15) + 1, (y) + h_10, (z & 15)), vec2(1, 0),
-                props.texture_indices[BLOCK_FACE_Y_POS],
-                BLOCK_FACE_Y_POS, light);
+                props->texture_indices[BLOCK_FACE_Y_POS],
+                BLOCK_FACE_Y_POS);
         v3 = makevert_complex(
                 vec3((x & 15), (y) + h_01, (z & 15) + 1), vec2(0, 1),
-                props.texture_indices[BLOCK_FACE_Y_POS],
-                BLOCK_FACE_Y_POS, light);
+                props->texture_indices[BLOCK_FACE_Y_POS],
+                BLOCK_FACE_Y_POS);
         v4 = makevert_complex(
                 vec3((x & 15) + 1, (y) + h_11, (z & 15) + 1), vec2(1, 1),
-                props.texture_indices[BLOCK_FACE_Y_POS],
-                BLOCK_FACE_Y_POS, light);
+                props->texture_indices[BLOCK_FACE_Y_POS],
+                BLOCK_FACE_Y_POS);
 
         //if(flowangle < 0)
         //	flowangle += 360.0f;
@@ -529,27 +858,35 @@ void render_fluid(int x, int y, int z, block_data self)
     }
 }
 
+static void add_template(int x, int y, int z, block_data self)
+{
+    int key = self.id << 4 | self.metadata;
+    const struct vert_complex *src = &templates.verts[templates.first[key]];
+    struct vert_complex *dst = meshbuilder_add_verts(templates.num[key]);
+    float xf = (float) (x & 15), yf = (float) y, zf = (float) (z & 15);
+
+    for(int i = 0; i < templates.num[key]; i++) {
+        dst[i] = src[i];
+        dst[i].pos.x += xf;
+        dst[i].pos.y += yf;
+        dst[i].pos.z += zf;
+    }
+}
+
 void render_null(int x attr(unused), int y attr(unused), int z attr(unused), block_data self attr(unused))
 {
 
 }
 
-void render_cross(int _x, int _y, int _z, block_data self)
+static void build_cross(block_data self)
 {
     struct vert_complex tl, tr, bl, br;
-    float x0 = (float) (_x & 15);
-    float y0 = (float) (_y);
-    float z0 = (float) (_z & 15);
-    float x1 = x0 + 1;
-    float y1 = y0 + 1;
-    float z1 = z0 + 1;
-    ubyte light = world_get_block_lighting_fast(self, _x, _y, _z);
-    ubyte texture = block_get_texture_index(self.id, 0, self.metadata, _x, _y, _z);
-
-    tl = makevert_complex(vec3(x1, y1, z0), vec2(0, 0), texture, BLOCK_FACE_Y_POS, light);
-    tr = makevert_complex(vec3(x0, y1, z1), vec2(1, 0), texture, BLOCK_FACE_Y_POS, light);
-    bl = makevert_complex(vec3(x1, y0, z0), vec2(0, 1), texture, BLOCK_FACE_Y_POS, light);
-    br = makevert_complex(vec3(x0, y0, z1), vec2(1, 1), texture, BLOCK_FACE_Y_POS, light);
+    ubyte texture = block_get_texture_index(self.id, 0, self.metadata, 0, 0, 0);
+
+    tl = makevert_complex(vec3(1, 1, 0), vec2(0, 0), texture, BLOCK_FACE_Y_POS);
+    tr = makevert_complex(vec3(0, 1, 1), vec2(1, 0), texture, BLOCK_FACE_Y_POS);
+    bl = makevert_complex(vec3(1, 0, 0), vec2(0, 1), texture, BLOCK_FACE_Y_POS);
+    br = makevert_complex(vec3(0, 0, 1), vec2(1, 1), texture, BLOCK_FACE_Y_POS);
     meshbuilder_add_quad(&tl, &tr, &bl, &br);
 
     tl.uv.u = 1;
@@ -558,10 +895,10 @@ void render_cross(int _x, int _y, int _z, block_data self)
     br.uv.u = 0;
     meshbuilder_add_quad(&tr, &tl, &br, &bl);
 
-    tl = makevert_complex(vec3(x0, y1, z0), vec2(0, 0), texture, BLOCK_FACE_Y_POS, light);
-    tr = makevert_complex(vec3(x1, y1, z1), vec2(1, 0), texture, BLOCK_FACE_Y_POS, light);
-    bl = makevert_complex(vec3(x0, y0, z0), vec2(0, 1), texture, BLOCK_FACE_Y_POS, light);
-    br = makevert_complex(vec3(x1, y0, z1), vec2(1, 1), texture, BLOCK_FACE_Y_POS, light);
+    tl = makevert_complex(vec3(0, 1, 0), vec2(0, 0), texture, BLOCK_FACE_Y_POS);
+    tr = makevert_complex(vec3(1, 1, 1), vec2(1, 0), texture, BLOCK_FACE_Y_POS);
+    bl = makevert_complex(vec3(0, 0, 0), vec2(0, 1), texture, BLOCK_FACE_Y_POS);
+    br = makevert_complex(vec3(1, 0, 1), vec2(1, 1), texture, BLOCK_FACE_Y_POS);
     meshbuilder_add_quad(&tl, &tr, &bl, &br);
 
     tl.uv.u = 1;
@@ -571,7 +908,12 @@ void render_cross(int _x, int _y, int _z, block_data self)
     meshbuilder_add_quad(&tr, &tl, &br, &bl);
 }
 
-void render_torch_impl(int _x, int _y, int _z, float _xf, float _yf, float _zf, block_data self)
+void render_cross(int x, int y, int z, block_data self)
+{
+    add_template(x, y, z, self);
+}
+
+static void build_torch_at(float _xf, float _yf, float _zf, block_data self)
 {
     float skew_x = 0.0f;
     float skew_z = 0.0f;
@@ -594,7 +936,6 @@ void render_torch_impl(int _x, int _y, int _z, float _xf, float _yf, float _zf,
     float z_phalf;
 
     int t;
-    ubyte l;
 
     switch(self.metadata) {
     case 1:
@@ -617,10 +958,6 @@ void render_torch_impl(int _x, int _y, int _z, float _xf, float _yf, float _zf,
         y = 0.0f;
     }
 
-    x += (float) (_x & 15);
-    y += (float) (_y);
-    z += (float) (_z & 15);
-
     x += _xf;
     y += _yf;
     z += _zf;
@@ -630,52 +967,55 @@ void render_torch_impl(int _x, int _y, int _z, float _xf, float _yf, float _zf,
     z_mhalf = z - 0.5f;
     z_phalf = z + 0.5f;
 
-    l = world_get_block_lighting_fast(self, _x, _y, _z);
-
     // +y
-    t = block_get_texture_index(self.id, BLOCK_FACE_Y_POS, self.metadata, _x, _y, _z);
-    tr = makevert_complex(vec3(x + skew_x * _6 - _1, y + _10, z + skew_z * _6 - _1), vec2(_7, _6), t, BLOCK_FACE_Y_POS, l);
-    tl = makevert_complex(vec3(x + skew_x * _6 - _1, y + _10, z + skew_z * _6 + _1), vec2(_7, _8), t, BLOCK_FACE_Y_POS, l);
-    br = makevert_complex(vec3(x + skew_x * _6 + _1, y + _10, z + skew_z * _6 - _1), vec2(_9, _6), t, BLOCK_FACE_Y_POS, l);
-    bl = makevert_complex(vec3(x + skew_x * _6 + _1, y + _10, z + skew_z * _6 + _1), vec2(_9, _8), t, BLOCK_FACE_Y_POS, l);
+    t = block_get_texture_index(self.id, BLOCK_FACE_Y_POS, self.metadata, 0, 0, 0);
+    tr = makevert_complex(vec3(x + skew_x * _6 - _1, y + _10, z + skew_z * _6 - _1), vec2(_7, _6), t, BLOCK_FACE_Y_POS);
+    tl = makevert_complex(vec3(x + skew_x * _6 - _1, y + _10, z + skew_z * _6 + _1), vec2(_7, _8), t, BLOCK_FACE_Y_POS);
+    br = makevert_complex(vec3(x + skew_x * _6 + _1, y + _10, z + skew_z * _6 - _1), vec2(_9, _6), t, BLOCK_FACE_Y_POS);
+    bl = makevert_complex(vec3(x + skew_x * _6 + _1, y + _10, z + skew_z * _6 + _1), vec2(_9, _8), t, BLOCK_FACE_Y_POS);
     meshbuilder_add_quad(&tl, &tr, &bl, &br);
 
     // -x
-    t = block_get_texture_index(self.id, BLOCK_FACE_X_NEG, self.metadata, _x, _y, _z);
-    tr = makevert_complex(vec3(x - _1, y + 1, z_mhalf), vec2(0, 0), t, BLOCK_FACE_Y_POS, l);
-    tl = makevert_complex(vec3(x - _1 + skew_x, y + 0, z_mhalf + skew_z), vec2(0, 1), t, BLOCK_FACE_Y_POS, l);
-    br = makevert_complex(vec3(x - _1, y + 1, z_phalf), vec2(1, 0), t, BLOCK_FACE_Y_POS, l);
-    bl = makevert_complex(vec3(x - _1 + skew_x, y + 0, z_phalf + skew_z), vec2(1, 1), t, BLOCK_FACE_Y_POS, l);
+    t = block_get_texture_index(self.id, BLOCK_FACE_X_NEG, self.metadata, 0, 0, 0);
+    tr = makevert_complex(vec3(x - _1, y + 1, z_mhalf), vec2(0, 0), t, BLOCK_FACE_Y_POS);
+    tl = makevert_complex(vec3(x - _1 + skew_x, y + 0, z_mhalf + skew_z), vec2(0, 1), t, BLOCK_FACE_Y_POS);
+    br = makevert_complex(vec3(x - _1, y + 1, z_phalf), vec2(1, 0), t, BLOCK_FACE_Y_POS);
+    bl = makevert_complex(vec3(x - _1 + skew_x, y + 0, z_phalf + skew_z), vec2(1, 1), t, BLOCK_FACE_Y_POS);
     meshbuilder_add_quad(&tl, &tr, &bl, &br);
 
     // +x
-    t = block_get_texture_index(self.id, BLOCK_FACE_X_POS, self.metadata, _x, _y, _z);
-    tr = makevert_complex(vec3(x + _1, y + 1, z_phalf), vec2(0, 0), t, BLOCK_FACE_Y_POS, l);
-    tl = makevert_complex(vec3(x + _1 + skew_x, y + 0, z_phalf + skew_z), vec2(0, 1), t, BLOCK_FACE_Y_POS, l);
-    br = makevert_complex(vec3(x + _1, y + 1, z_mhalf), vec2(1, 0), t, BLOCK_FACE_Y_POS, l);
-    bl = makevert_complex(vec3(x + _1 + skew_x, y + 0, z_mhalf + skew_z), vec2(1, 1), t, BLOCK_FACE_Y_POS, l);
+    t = block_get_texture_index(self.id, BLOCK_FACE_X_POS, self.metadata, 0, 0, 0);
+    tr = makevert_complex(vec3(x + _1, y + 1, z_phalf), vec2(0, 0), t, BLOCK_FACE_Y_POS);
+    tl = makevert_complex(vec3(x + _1 + skew_x, y + 0, z_phalf + skew_z), vec2(0, 1), t, BLOCK_FACE_Y_POS);
+    br = makevert_complex(vec3(x + _1, y + 1, z_mhalf), vec2(1, 0), t, BLOCK_FACE_Y_POS);
+    bl = makevert_complex(vec3(x + _1 + skew_x, y + 0, z_mhalf + skew_z), vec2(1, 1), t, BLOCK_FACE_Y_POS);
     meshbuilder_add_quad(&tl, &tr, &bl, &br);
 
     // -z
-    t = block_get_texture_index(self.id, BLOCK_FACE_Z_NEG, self.metadata, _x, _y, _z);
-    tr = makevert_complex(vec3(x_mhalf + skew_x, y + 0, z - _1 + skew_z), vec2(1, 1), t, BLOCK_FACE_Y_POS, l);
-    tl = makevert_complex(vec3(x_mhalf, y + 1, z - _1), vec2(1, 0), t, BLOCK_FACE_Y_POS, l);
-    br = makevert_complex(vec3(x_phalf + skew_x, y + 0, z - _1 + skew_z), vec2(0, 1), t, BLOCK_FACE_Y_POS, l);
-    bl = makevert_complex(vec3(x_phalf, y + 1, z - _1), vec2(0, 0), t, BLOCK_FACE_Y_POS, l);
+    t = block_get_texture_index(self.id, BLOCK_FACE_Z_NEG, self.metadata, 0, 0, 0);
+    tr = makevert_complex(vec3(x_mhalf + skew_x, y + 0, z - _1 + skew_z), vec2(1, 1), t, BLOCK_FACE_Y_POS);
+    tl = makevert_complex(vec3(x_mhalf, y + 1, z - _1), vec2(1, 0), t, BLOCK_FACE_Y_POS);
+    br = makevert_complex(vec3(x_phalf + skew_x, y + 0, z - _1 + skew_z), vec2(0, 1), t, BLOCK_FACE_Y_POS);
+    bl = makevert_complex(vec3(x_phalf, y + 1, z - _1), vec2(0, 0), t, BLOCK_FACE_Y_POS);
     meshbuilder_add_quad(&tl, &tr, &bl, &br);
 
     // +z
-    t = block_get_texture_index(self.id, BLOCK_FACE_Z_POS, self.metadata, _x, _y, _z);
-    tr = makevert_complex(vec3(x_phalf + skew_x, y + 0, z + _1 + skew_z), vec2(1, 1), t, BLOCK_FACE_Y_POS, l);
-    tl = makevert_complex(vec3(x_phalf, y + 1, z + _1), vec2(1, 0), t, BLOCK_FACE_Y_POS, l);
-    br = makevert_complex(vec3(x_mhalf + skew_x, y + 0, z + _1 + skew_z), vec2(0, 1), t, BLOCK_FACE_Y_POS, l);
-    bl = makevert_complex(vec3(x_mhalf, y + 1, z + _1), vec2(0, 0), t, BLOCK_FACE_Y_POS, l);
+    t = block_get_texture_index(self.id, BLOCK_FACE_Z_POS, self.metadata, 0, 0, 0);
+    tr = makevert_complex(vec3(x_phalf + skew_x, y + 0, z + _1 + skew_z), vec2(1, 1), t, BLOCK_FACE_Y_POS);
+    tl = makevert_complex(vec3(x_phalf, y + 1, z + _1), vec2(1, 0), t, BLOCK_FACE_Y_POS);
+    br = makevert_complex(vec3(x_mhalf + skew_x, y + 0, z + _1 + skew_z), vec2(0, 1), t, BLOCK_FACE_Y_POS);
+    bl = makevert_complex(vec3(x_mhalf, y + 1, z + _1), vec2(0, 0), t, BLOCK_FACE_Y_POS);
     meshbuilder_add_quad(&tl, &tr, &bl, &br);
 }
 
+static void build_torch(block_data self)
+{
+    build_torch_at(0, 0, 0, self);
+}
+
 void render_torch(int x, int y, int z, block_data self)
 {
-    render_torch_impl(x, y, z, 0, 0, 0, self);
+    add_template(x, y, z, self);
 }
 
 void render_fire(int x, int y, int z, block_data self)
@@ -721,7 +1061,6 @@ static bool wire_passthrough(block_data b)
 void render_wire(int x, int y, int z, block_data self)
 {
     const float _1_64 = 1.0f / 64.0f;
-    ubyte light = world_get_block_lighting(x, y, z);
     ubyte r, g, b;
     float power;
     bool xn, xp, zn, zp;
@@ -742,21 +1081,26 @@ void render_wire(int x, int y, int z, block_data self)
     b = (ubyte) max(0.0f, (power * power * 0.6f - 0.7f) * 255.0f);
 
     uxn = uxp = uzn = uzp = false;
-    xn = can_connect_to_wire(x - 1, y, z, BLOCK_FACE_X_POS);
-    xp = can_connect_to_wire(x + 1, y, z, BLOCK_FACE_X_NEG);
-    zn = can_connect_to_wire(x, y, z - 1, BLOCK_FACE_Z_POS);
-    zp = can_connect_to_wire(x, y, z + 1, BLOCK_FACE_Z_NEG);
-
-    // todo: connect down too....
-    if(wire_passthrough(world_get_block(x, y + 1, z))) {
-        uxn = can_connect_to_wire(x - 1, y + 1, z, BLOCK_FACE_X_POS);
-        uxp = can_connect_to_wire(x + 1, y + 1, z, BLOCK_FACE_X_NEG);
-        uzn = can_connect_to_wire(x, y + 1, z - 1, BLOCK_FACE_Z_POS);
-        uzp = can_connect_to_wire(x, y + 1, z + 1, BLOCK_FACE_Z_NEG);
-        xn |= uxn;
-        xp |= uxp;
-        zn |= uzn;
-        zp |= uzp;
+    if(mesh_far_section) {
+        // far away it is drawn as if connected everywhere, without looking at the neighbours
+        xn = xp = zn = zp = true;
+    } else {
+        xn = can_connect_to_wire(x - 1, y, z, BLOCK_FACE_X_POS);
+        xp = can_connect_to_wire(x + 1, y, z, BLOCK_FACE_X_NEG);
+        zn = can_connect_to_wire(x, y, z - 1, BLOCK_FACE_Z_POS);
+        zp = can_connect_to_wire(x, y, z + 1, BLOCK_FACE_Z_NEG);
+
+        // todo: connect down too....
+        if(wire_passthrough(world_get_block(x, y + 1, z))) {
+            uxn = can_connect_to_wire(x - 1, y + 1, z, BLOCK_FACE_X_POS);
+            uxp = can_connect_to_wire(x + 1, y + 1, z, BLOCK_FACE_X_NEG);
+            uzn = can_connect_to_wire(x, y + 1, z - 1, BLOCK_FACE_Z_POS);
+            uzp = can_connect_to_wire(x, y + 1, z + 1, BLOCK_FACE_Z_NEG);
+            xn |= uxn;
+            xp |= uxp;
+            zn |= uzn;
+            zp |= uzp;
+        }
     }
 
     if((xn || xp) && !zn && !zp) {
@@ -795,20 +1139,20 @@ void render_wire(int x, int y, int z, block_data self)
                 uv1.v -= 5.0f / 16.0f;
             }
         }
-        tl = makevert_complex(vec3(v0.x, v1.y, v0.z), vec2(uv0.u, uv0.v), t, BLOCK_FACE_Y_POS, light);
-        tr = makevert_complex(vec3(v1.x, v1.y, v0.z), vec2(uv1.u, uv0.v), t, BLOCK_FACE_Y_POS, light);
-        bl = makevert_complex(vec3(v0.x, v1.y, v1.z), vec2(uv0.u, uv1.v), t, BLOCK_FACE_Y_POS, light);
-        br = makevert_complex(vec3(v1.x, v1.y, v1.z), vec2(uv1.u, uv1.v), t, BLOCK_FACE_Y_POS, light);
+        tl = makevert_complex(vec3(v0.x, v1.y, v0.z), vec2(uv0.u, uv0.v), t, BLOCK_FACE_Y_POS);
+        tr = makevert_complex(vec3(v1.x, v1.y, v0.z), vec2(uv1.u, uv0.v), t, BLOCK_FACE_Y_POS);
+        bl = makevert_complex(vec3(v0.x, v1.y, v1.z), vec2(uv0.u, uv1.v), t, BLOCK_FACE_Y_POS);
+        br = makevert_complex(vec3(v1.x, v1.y, v1.z), vec2(uv1.u, uv1.v), t, BLOCK_FACE_Y_POS);
     } else if(straight == 1) {
-        tl = makevert_complex(vec3(v0.x, v1.y, v0.z), vec2(uv0.u, uv0.v), t, BLOCK_FACE_Y_POS, light);
-        tr = makevert_complex(vec3(v1.x, v1.y, v0.z), vec2(uv1.u, uv0.v), t, BLOCK_FACE_Y_POS, light);
-        bl = makevert_complex(vec3(v0.x, v1.y, v1.z), vec2(uv0.u, uv1.v), t, BLOCK_FACE_Y_POS, light);
-        br = makevert_complex(vec3(v1.x, v1.y, v1.z), vec2(uv1.u, uv1.v), t, BLOCK_FACE_Y_POS, light);
+        tl = makevert_complex(vec3(v0.x, v1.y, v0.z), vec2(uv0.u, uv0.v), t, BLOCK_FACE_Y_POS);
+        tr = makevert_complex(vec3(v1.x, v1.y, v0.z), vec2(uv1.u, uv0.v), t, BLOCK_FACE_Y_POS);
+        bl = makevert_complex(vec3(v0.x, v1.y, v1.z), vec2(uv0.u, uv1.v), t, BLOCK_FACE_Y_POS);
+        br = makevert_complex(vec3(v1.x, v1.y, v1.z), vec2(uv1.u, uv1.v), t, BLOCK_FACE_Y_POS);
     } else {
-        tl = makevert_complex(vec3(v0.x, v1.y, v0.z), vec2(uv0.u, uv0.v), t, BLOCK_FACE_Y_POS, light);
-        tr = makevert_complex(vec3(v1.x, v1.y, v0.z), vec2(uv0.u, uv1.v), t, BLOCK_FACE_Y_POS, light);
-        bl = makevert_complex(vec3(v0.x, v1.y, v1.z), vec2(uv1.u, uv0.v), t, BLOCK_FACE_Y_POS, light);
-        br = makevert_complex(vec3(v1.x, v1.y, v1.z), vec2(uv1.u, uv1.v), t, BLOCK_FACE_Y_POS, light);
+        tl = makevert_complex(vec3(v0.x, v1.y, v0.z), vec2(uv0.u, uv0.v), t, BLOCK_FACE_Y_POS);
+        tr = makevert_complex(vec3(v1.x, v1.y, v0.z), vec2(uv0.u, uv1.v), t, BLOCK_FACE_Y_POS);
+        bl = makevert_complex(vec3(v0.x, v1.y, v1.z), vec2(uv1.u, uv0.v), t, BLOCK_FACE_Y_POS);
+        br = makevert_complex(vec3(v1.x, v1.y, v1.z), vec2(uv1.u, uv1.v), t, BLOCK_FACE_Y_POS);
     }
 
     tl.r = r;
@@ -827,77 +1171,77 @@ void render_wire(int x, int y, int z, block_data self)
     meshbuilder_add_quad(&tl, &tr, &bl, &br);
 }
 
-static void render_with_side_translation(int x, int y, int z, ubyte light, ubyte texture, float translation, bool diff_faces)
+static void build_with_side_translation(ubyte texture, float translation, bool diff_faces)
 {
     struct vert_complex tl, tr, bl, br;
     float x0, x1, z0, z1;
     block_face face = BLOCK_FACE_Y_POS;
 
-    x &= 15;
-    z &= 15;
-
-    x0 = x + translation;
-    x1 = x + 1.0f - translation;
-    z0 = z;
-    z1 = z + 1.0f;
+    x0 = translation;
+    x1 = 1.0f - translation;
+    z0 = 0.0f;
+    z1 = 1.0f;
 
     if(diff_faces)
         face = BLOCK_FACE_X_NEG;
-    tl = makevert_complex(vec3(x0, y + 1, z0), vec2(0, 0), texture, face, light);
-    tr = makevert_complex(vec3(x0, y + 1, z1), vec2(1, 0), texture, face, light);
-    bl = makevert_complex(vec3(x0, y, z0), vec2(0, 1), texture, face, light);
-    br = makevert_complex(vec3(x0, y, z1), vec2(1, 1), texture, face, light);
+    tl = makevert_complex(vec3(x0, 1, z0), vec2(0, 0), texture, face);
+    tr = makevert_complex(vec3(x0, 1, z1), vec2(1, 0), texture, face);
+    bl = makevert_complex(vec3(x0, 0, z0), vec2(0, 1), texture, face);
+    br = makevert_complex(vec3(x0, 0, z1), vec2(1, 1), texture, face);
     meshbuilder_add_quad(&tl, &tr, &bl, &br);
     meshbuilder_add_quad(&tr, &tl, &br, &bl);
 
     if(diff_faces)
         face = BLOCK_FACE_X_POS;
-    tl = makevert_complex(vec3(x1, y + 1, z0), vec2(1, 0), texture, face, light);
-    tr = makevert_complex(vec3(x1, y + 1, z1), vec2(0, 0), texture, face, light);
-    bl = makevert_complex(vec3(x1, y, z0), vec2(1, 1), texture, face, light);
-    br = makevert_complex(vec3(x1, y, z1), vec2(0, 1), texture, face, light);
+    tl = makevert_complex(vec3(x1, 1, z0), vec2(1, 0), texture, face);
+    tr = makevert_complex(vec3(x1, 1, z1), vec2(0, 0), texture, face);
+    bl = makevert_complex(vec3(x1, 0, z0), vec2(1, 1), texture, face);
+    br = makevert_complex(vec3(x1, 0, z1), vec2(0, 1), texture, face);
     meshbuilder_add_quad(&tl, &tr, &bl, &br);
     meshbuilder_add_quad(&tr, &tl, &br, &bl);
 
-    x0 = x;
-    x1 = x + 1.0f;
-    z0 = z + translation;
-    z1 = z + 1.0f - translation;
+    x0 = 0.0f;
+    x1 = 1.0f;
+    z0 = translation;
+    z1 = 1.0f - translation;
 
     if(diff_faces)
         face = BLOCK_FACE_Z_NEG;
-    tl = makevert_complex(vec3(x0, y + 1, z0), vec2(1, 0), texture, face, light);
-    tr = makevert_complex(vec3(x1, y + 1, z0), vec2(0, 0), texture, face, light);
-    bl = makevert_complex(vec3(x0, y, z0), vec2(1, 1), texture, face, light);
-    br = makevert_complex(vec3(x1, y, z0), vec2(0, 1), texture, face, light);
+    tl = makevert_complex(vec3(x0, 1, z0), vec2(1, 0), texture, face);
+    tr = makevert_complex(vec3(x1, 1, z0), vec2(0, 0), texture, face);
+    bl = makevert_complex(vec3(x0, 0, z0), vec2(1, 1), texture, face);
+    br = makevert_complex(vec3(x1, 0, z0), vec2(0, 1), texture, face);
     meshbuilder_add_quad(&tl, &tr, &bl, &br);
     meshbuilder_add_quad(&tr, &tl, &br, &bl);
 
     if(diff_faces)
         face = BLOCK_FACE_Z_POS;
-    tl = makevert_complex(vec3(x0, y + 1, z1), vec2(0, 0), texture, face, light);
-    tr = makevert_complex(vec3(x1, y + 1, z1), vec2(1, 0), texture, face, light);
-    bl = makevert_complex(vec3(x0, y, z1), vec2(0, 1), texture, face, light);
-    br = makevert_complex(vec3(x1, y, z1), vec2(1, 1), texture, face, light);
+    tl = makevert_complex(vec3(x0, 1, z1), vec2(0, 0), texture, face);
+    tr = makevert_complex(vec3(x1, 1, z1), vec2(1, 0), texture, face);
+    bl = makevert_complex(vec3(x0, 0, z1), vec2(0, 1), texture, face);
+    br = makevert_complex(vec3(x1, 0, z1), vec2(1, 1), texture, face);
     meshbuilder_add_quad(&tl, &tr, &bl, &br);
     meshbuilder_add_quad(&tr, &tl, &br, &bl);
 }
 
+static void build_crops(block_data self)
+{
+    ubyte texture = block_get_texture_index(self.id, 0, self.metadata, 0, 0, 0);
+    build_with_side_translation(texture, 0.25f, false);
+}
+
 void render_crops(int x, int y, int z, block_data self)
 {
-    ubyte light = world_get_block_lighting_fast(self, x, y, z);
-    ubyte texture = block_get_texture_index(self.id, 0, self.metadata, x, y, z);
-    render_with_side_translation(x, y, z, light, texture, 0.25f, false);
+    add_template(x, y, z, self);
 }
 
-void render_ladder(int x, int y, int z, block_data self)
+static void build_ladder(block_data self)
 {
     block_face face;
     struct vert_complex vert;
-    ubyte texture, light;
-    float xf = (float) (x & 15);
-    float yf = (float) (y);
-    float zf = (float) (z & 15);
+    ubyte texture;
+    float xf = 0.0f;
+    float zf = 0.0f;
 
     switch(self.metadata) {
     case 2:
@@ -921,24 +1265,26 @@ void render_ladder(int x, int y, int z, block_data self)
         break;
     }
 
-    light = world_get_block_lighting_fast(self, x, y, z);
-    texture = block_get_texture_index(self.id, face, self.metadata, x, y, z);
-    vert = makevert_complex(vec3(xf, yf, zf), vec2(0, 0), texture, face, light);
+    texture = block_get_texture_index(self.id, face, self.metadata, 0, 0, 0);
+    vert = makevert_complex(vec3(xf, 0, zf), vec2(0, 0), texture, face);
 
     add_block_face(vert, face);
 }
 
-void render_rail(int x, int y, int z, block_data self)
+void render_ladder(int x, int y, int z, block_data self)
+{
+    add_template(x, y, z, self);
+}
+
+static void build_rail(block_data self)
 {
     int texture;
-    ubyte light;
-    float x0 = (float) (x & 15);
-    float y0 = (float) (y);
-    float z0 = (float) (z & 15);
+    float x0 = 0.0f;
+    float z0 = 0.0f;
     float _1 = 1.0f / 16.0f;
-    float x1 = x0 + 1;
-    float y1 = y0 + _1;
-    float z1 = z0 + 1;
+    float x1 = 1.0f;
+    float y1 = _1;
+    float z1 = 1.0f;
 
     struct vert_complex tl, tr, bl, br;
     vec3_t v_tl, v_tr, v_bl, v_br;
@@ -954,8 +1300,7 @@ void render_rail(int x, int y, int z, block_data self)
     uv_bl = vec2(0, 1);
     uv_br = vec2(1, 1);
 
-    light = world_get_block_lighting_fast(self, x, y, z);
-    texture = block_get_texture_index(self.id, BLOCK_FACE_Y_POS, self.metadata, x, y, z);
+    texture = block_get_texture_index(self.id, BLOCK_FACE_Y_POS, self.metadata, 0, 0, 0);
 
     // see file notes/metadata_rails.png
     switch(self.metadata) {
@@ -1007,28 +1352,35 @@ void render_rail(int x, int y, int z, block_data self)
     default:
         break;
     }
-    tl = makevert_complex(v_tl, uv_tl, texture, BLOCK_FACE_Y_POS, light);
-    tr = makevert_complex(v_tr, uv_tr, texture, BLOCK_FACE_Y_POS, light);
-    bl = makevert_complex(v_bl, uv_bl, texture, BLOCK_FACE_Y_POS, light);
-    br = makevert_complex(v_br, uv_br, texture, BLOCK_FACE_Y_POS, light);
+    tl = makevert_complex(v_tl, uv_tl, texture, BLOCK_FACE_Y_POS);
+    tr = makevert_complex(v_tr, uv_tr, texture, BLOCK_FACE_Y_POS);
+    bl = makevert_complex(v_bl, uv_bl, texture, BLOCK_FACE_Y_POS);
+    br = makevert_complex(v_br, uv_br, texture, BLOCK_FACE_Y_POS);
     meshbuilder_add_quad(&tl, &tr, &bl, &br); // top face
     meshbuilder_add_quad(&tr, &tl, &br, &bl); // bottom face
 }
 
-void add_stair_bboxes(bbox_t *colliders, size_t *n_colliders, block_data block, int x, int y, int z, bbox_t box);
+void render_rail(int x, int y, int z, block_data self)
+{
+    add_template(x, y, z, self);
+}
 
 void render_stairs(int x, int y, int z, block_data self)
 {
-    bbox_t bboxes[2] = {0};
-    size_t n = 0;
-    add_stair_bboxes(bboxes, &n, self, 0, 0, 0, (bbox_t){vec3_1(-1), vec3_1(1)});
-    render_box(x, y, z, bboxes[0], self, SIDE_ALL);
-    render_box(x, y, z, bboxes[1], self, SIDE_ALL);
+    const block_shape *shape = block_get_shape(self, false);
+
+    for(int i = 0; i < shape->count; i++)
+        render_box(x, y, z, shape->boxes[i], self, SIDE_ALL);
+}
+
+static void build_cactus(block_data self)
+{
+    ubyte texture = block_get_texture_index(self.id, BLOCK_FACE_X_POS, self.metadata, 0, 0, 0);
+    build_with_side_translation(texture, 1.0f / 16.0f, true);
 }
 
 void render_cactus(int x, int y, int z, block_data self)
 {
-    ubyte light;
     ubyte texture;
 
     if(block_should_render_face(x, y, z, self, BLOCK_FACE_Y_NEG)) {
@@ -1036,9 +1388,8 @@ void render_cactus(int x, int y, int z, block_data self)
         struct vert_complex vert;
 
         texture = block_get_texture_index(self.id, BLOCK_FACE_Y_NEG, self.metadata, x, y, z);
-        light = world_get_block_lighting(x, y - 1, z);
 
-        vert = makevert_complex(vec3(xf, yf, zf), vec2(0, 0), texture, BLOCK_FACE_Y_NEG, light);
+        vert = makevert_complex(vec3(xf, yf, zf), vec2(0, 0), texture, BLOCK_FACE_Y_NEG);
 
         add_block_face(vert, BLOCK_FACE_Y_NEG);
     }
@@ -1048,31 +1399,25 @@ void render_cactus(int x, int y, int z, block_data self)
         struct vert_complex vert;
 
         texture = block_get_texture_index(self.id, BLOCK_FACE_Y_POS, self.metadata, x, y, z);
-        light = world_get_block_lighting(x, y + 1, z);
 
-        vert = makevert_complex(vec3(xf, yf, zf), vec2(0, 0), texture, BLOCK_FACE_Y_POS, light);
+        vert = makevert_complex(vec3(xf, yf, zf), vec2(0, 0), texture, BLOCK_FACE_Y_POS);
 
         add_block_face(vert, BLOCK_FACE_Y_POS);
     }
 
     /* render sides */
-    light = world_get_block_lighting_fast(self, x, y, z);
-    texture = block_get_texture_index(self.id, BLOCK_FACE_X_POS, self.metadata, x, y, z);
-    render_with_side_translation(x, y, z, light, texture, 1.0f / 16.0f, true);
+    add_template(x, y, z, self);
 }
 
-void render_bed(int x, int y, int z, block_data self)
+static void build_bed(block_data self)
 {
-    bbox_t bbox = block_get_bbox(self, 0, 0, 0, false);
-
-    float x0 = (float) (x & 15);
-    float y0 = (float) (y) + 3.0f / 16.0f;
-    float z0 = (float) (z & 15);
-    float x1 = x0 + 1;
+    float x0 = 0.0f;
+    float y0 = 3.0f / 16.0f;
+    float z0 = 0.0f;
+    float x1 = 1.0f;
     float y1 = y0 + 6.0f / 16.0f;
-    float z1 = z0 + 1;
+    float z1 = 1.0f;
 
-    ubyte light = world_get_block_lighting(x, y, z);
     int texture;
 
     struct vert_complex tl, tr, bl, br;
@@ -1088,11 +1433,11 @@ void render_bed(int x, int y, int z, block_data self)
     v_tr = vec3(x1, y0, z0);
     v_bl = vec3(x0, y0, z1);
     v_br = vec3(x1, y0, z1);
-    texture = block_get_texture_index(self.id, BLOCK_FACE_Y_NEG, self.metadata, x, y, z);
-    tl = makevert_complex(v_tl, uv_tl, texture, BLOCK_FACE_Y_NEG, light);
-    tr = makevert_complex(v_tr, uv_tr, texture, BLOCK_FACE_Y_NEG, light);
-    bl = makevert_complex(v_bl, uv_bl, texture, BLOCK_FACE_Y_NEG, light);
-    br = makevert_complex(v_br, uv_br, texture, BLOCK_FACE_Y_NEG, light);
+    texture = block_get_texture_index(self.id, BLOCK_FACE_Y_NEG, self.metadata, 0, 0, 0);
+    tl = makevert_complex(v_tl, uv_tl, texture, BLOCK_FACE_Y_NEG);
+    tr = makevert_complex(v_tr, uv_tr, texture, BLOCK_FACE_Y_NEG);
+    bl = makevert_complex(v_bl, uv_bl, texture, BLOCK_FACE_Y_NEG);
+    br = makevert_complex(v_br, uv_br, texture, BLOCK_FACE_Y_NEG);
     meshbuilder_add_quad(&tr, &tl, &br, &bl);
 
     v_tl = vec3(x0, y1, z0);
@@ -1123,32 +1468,34 @@ void render_bed(int x, int y, int z, block_data self)
         break;
     }
 
-    render_box(x, y, z, bbox, self, SIDE_ALL & ~(SIDE_YN | SIDE_YP));
-
-    texture = block_get_texture_index(self.id, BLOCK_FACE_Y_POS, self.metadata, x, y, z);
-    tl = makevert_complex(v_tl, uv_tl, texture, BLOCK_FACE_Y_POS, light);
-    tr = makevert_complex(v_tr, uv_tr, texture, BLOCK_FACE_Y_POS, light);
-    bl = makevert_complex(v_bl, uv_bl, texture, BLOCK_FACE_Y_POS, light);
-    br = makevert_complex(v_br, uv_br, texture, BLOCK_FACE_Y_POS, light);
+    texture = block_get_texture_index(self.id, BLOCK_FACE_Y_POS, self.metadata, 0, 0, 0);
+    tl = makevert_complex(v_tl, uv_tl, texture, BLOCK_FACE_Y_POS);
+    tr = makevert_complex(v_tr, uv_tr, texture, BLOCK_FACE_Y_POS);
+    bl = makevert_complex(v_bl, uv_bl, texture, BLOCK_FACE_Y_POS);
+    br = makevert_complex(v_br, uv_br, texture, BLOCK_FACE_Y_POS);
     meshbuilder_add_quad(&tl, &tr, &bl, &br);
 }
 
-void render_repeater(int x, int y, int z, block_data self)
+void render_bed(int x, int y, int z, block_data self)
+{
+    add_template(x, y, z, self);
+    render_box(x, y, z, block_get_bbox(self, 0, 0, 0, false), self, SIDE_ALL & ~(SIDE_YN | SIDE_YP));
+}
+
+static void build_repeater(block_data self)
 {
-    block_data torch = {BLOCK_TORCH_REDSTONE_DISABLED, 0, self.skylight, self.blocklight};
+    block_data torch = {BLOCK_TORCH_REDSTONE_DISABLED, 0, 0, 0};
     float ox = 0.0f;
     float oz = 0.0f;
     int ticks = (self.metadata & METADATA_REPEATER_TICK) >> 2;
     float offset = -5.0f / 16.0f;
 
-    float x0 = (float) (x & 15);
-    float y0 = (float) (y);
-    float z0 = (float) (z & 15);
-    float x1 = x0 + 1;
-    float y1 = y0 + 2.0f / 16.0f;
-    float z1 = z0 + 1;
+    float x0 = 0.0f;
+    float z0 = 0.0f;
+    float x1 = 1.0f;
+    float y1 = 2.0f / 16.0f;
+    float z1 = 1.0f;
 
-    ubyte light = world_get_block_lighting(x, y, z);
     int texture;
 
     struct vert_complex tl, tr, bl, br;
@@ -1172,7 +1519,7 @@ void render_repeater(int x, int y, int z, block_data self)
         ox = offset;
         break;
     }
-    render_torch_impl(x, y, z, ox, -0.2f, oz, torch);
+    build_torch_at(ox, -0.2f, oz, torch);
 
     offset = -1.0f / 16.0f + (float) ticks * 2.0f / 16.0f;
     switch(self.metadata & METADATA_REPEATER_ROT) {
@@ -1189,9 +1536,7 @@ void render_repeater(int x, int y, int z, block_data self)
         ox = offset;
         break;
     }
-    render_torch_impl(x, y, z, ox, -0.2f, oz, torch);
-
-    render_box(x, y, z, block_get_bbox(self, 0, 0, 0, false), self, SIDE_ALL & ~(SIDE_YN | SIDE_YP));
+    build_torch_at(ox, -0.2f, oz, torch);
 
     // render top face
 
@@ -1228,14 +1573,20 @@ void render_repeater(int x, int y, int z, block_data self)
         break;
     }
 
-    texture = block_get_texture_index(self.id, BLOCK_FACE_Y_POS, self.metadata, x, y, z);
-    tl = makevert_complex(v_tl, uv_tl, texture, BLOCK_FACE_Y_POS, light);
-    tr = makevert_complex(v_tr, uv_tr, texture, BLOCK_FACE_Y_POS, light);
-    bl = makevert_complex(v_bl, uv_bl, texture, BLOCK_FACE_Y_POS, light);
-    br = makevert_complex(v_br, uv_br, texture, BLOCK_FACE_Y_POS, light);
+    texture = block_get_texture_index(self.id, BLOCK_FACE_Y_POS, self.metadata, 0, 0, 0);
+    tl = makevert_complex(v_tl, uv_tl, texture, BLOCK_FACE_Y_POS);
+    tr = makevert_complex(v_tr, uv_tr, texture, BLOCK_FACE_Y_POS);
+    bl = makevert_complex(v_bl, uv_bl, texture, BLOCK_FACE_Y_POS);
+    br = makevert_complex(v_br, uv_br, texture, BLOCK_FACE_Y_POS);
     meshbuilder_add_quad(&tl, &tr, &bl, &br);
 }
 
+void render_repeater(int x, int y, int z, block_data self)
+{
+    add_template(x, y, z, self);
+    render_box(x, y, z, block_get_bbox(self, 0, 0, 0, false), self, SIDE_ALL & ~(SIDE_YN | SIDE_YP));
+}
+
 void render_cube_special(int x, int y, int z, block_data self)
 {
     bbox_t box = block_get_bbox(self, x, y, z, true);
@@ -1244,13 +1595,6 @@ void render_cube_special(int x, int y, int z, block_data self)
     render_box(x, y, z, box, self, SIDE_ALL);
 }
 
-void render_grass_side_overlay(int x, int y, int z, block_data self)
-{
-    self.id = BLOCK_GRASS_OVERLAY;
-    render_box(x, y, z, block_get_bbox(self, 0, 0, 0, false), self, SIDE_ALL & ~(SIDE_YN | SIDE_YP));
-}
-
-// todo: check whether all of these use the correct lighting like should they use the light at x,y,z or maybe xyz + face offset etc.
 void (*render_funcs[RENDER_TYPE_COUNT])(int, int, int, block_data) = {
         [RENDER_CUBE] = render_cube_special, // handled elsewhere tho (not yet tho)
         [RENDER_CROSS] = render_cross,
@@ -1274,6 +1618,107 @@ void (*render_funcs[RENDER_TYPE_COUNT])(int, int, int, block_data) = {
         [RENDER_NONE] = render_null
 };
 
+// like fast leaves: opaque texture, no faces between two leaves
+static void render_far_leaves(int x, int y, int z, block_data self)
+{
+    const int ofs[6][3] = {{0, -1, 0}, {0, 1, 0}, {0, 0, -1}, {0, 0, 1}, {-1, 0, 0}, {1, 0, 0}};
+    vec3_t pos = vec3(x & 15, y, z & 15);
+
+    for(int face = 0; face < 6; face++) {
+        block_data other = world_get_block(x + ofs[face][0], y + ofs[face][1], z + ofs[face][2]);
+        int texture;
+
+        if(other.id == BLOCK_LEAVES || !block_is_transparent(other))
+            continue;
+
+        texture = block_get_texture_index(self.id, face, self.metadata, x, y, z) + 1;
+        add_block_face(makevert_complex(pos, vec2(0, 0), texture, face), face);
+    }
+}
+
+static void render_far(int x, int y, int z, block_data self, block_render_type render_type)
+{
+    switch(render_type) {
+    case RENDER_CROSS:
+    case RENDER_CROPS:
+        break;
+    case RENDER_CUBE:
+        if(self.id == BLOCK_LEAVES && r_fancyleaves.integer) {
+            meshbuilder_set_bucket(SECTION_BUCKET(RENDER_PASS_OPAQUE, y >> 4));
+            render_far_leaves(x, y, z, self);
+            break;
+        }
+        /* fall through */
+    default:
+        render_funcs[render_type](x, y, z, self);
+        break;
+    }
+}
+
+static ubyte get_detail_sections(const world_chunk *chunk)
+{
+    ubyte mask = 0;
+
+    if(r_detail_distance.value <= 0.0f)
+        return (ubyte) ((1 << WORLD_CHUNK_SECTIONS) - 1);
+
+    for(int section = 0; section < WORLD_CHUNK_SECTIONS; section++) {
+        vec3_t center = vec3(chunk->x * WORLD_CHUNK_SIZE + 8, section * 16 + 8, chunk->z * WORLD_CHUNK_SIZE + 8);
+        bool detailed = (chunk->gl.detail_sections & (1 << section)) != 0;
+        float limit = r_detail_distance.value + (detailed ? DETAIL_MARGIN : -DETAIL_MARGIN);
+
+        if(vec3_len(vec3_sub(center, cam_pos)) <= limit)
+            mask |= 1 << section;
+    }
+
+    return mask;
+}
+
+static void (*template_funcs[RENDER_TYPE_COUNT])(block_data) = {
+        [RENDER_CROSS] = build_cross,
+        [RENDER_TORCH] = build_torch,
+        [RENDER_CROPS] = build_crops,
+        [RENDER_LADDER] = build_ladder,
+        [RENDER_RAIL] = build_rail,
+        [RENDER_CACTUS] = build_cactus,
+        [RENDER_BED] = build_bed,
+        [RENDER_REPEATER] = build_repeater
+};
+
+// needs the block texture table, so this waits for the first remesh instead of world_renderer_init
+static void build_templates(void)
+{
+    struct vert_complex *verts;
+    size_t num_verts;
+
+    templates.count = 0;
+    for(int key = 0; key < 256 * 16; key++) {
+        block_data self = {.id = key >> 4, .metadata = key & 15};
+        void (*func)(block_data) = template_funcs[block_get_render_type(self.id)];
+
+        templates.first[key] = templates.count;
+        templates.num[key] = 0;
+        if(func == NULL)
+            continue;
+
+        meshbuilder_start(sizeof(struct vert_complex));
+        func(self);
+        meshbuilder_finish((void **) &verts, &num_verts, NULL, NULL, NULL);
+
+        if(templates.count + num_verts > templates.capacity) {
+            templates.capacity = (templates.count + num_verts) * 2;
+            templates.verts = realloc(templates.verts, templates.capacity * sizeof(*templates.verts));
+        }
+        if(num_verts > 0)
+            memcpy(&templates.verts[templates.count], verts, num_verts * sizeof(*verts));
+        templates.num[key] = num_verts;
+        templates.count += num_verts;
+        mem_free(verts);
+    }
+
+    templates.built = true;
+}
+
 static void remesh_chunk_simple(world_chunk *chunk)
 {
     if(!chunk->gl.needs_remesh_simple)
@@ -1288,25 +1733,86 @@ static void remesh_chunk_simple(world_chunk *chunk)
 
     //
 
-    meshbuilder_finish((void **) &chunk->gl.verts_simple, &chunk->gl.n_verts_simple, NULL, NULL);
+    meshbuilder_finish((void **) &chunk->gl.verts_simple, &chunk->gl.n_verts_simple, NULL, NULL, NULL);
 
-    glBindBuffer(GL_ARRAY_BUFFER, chunk->gl.vbo_simple);
-    glBufferData(GL_ARRAY_BUFFER,
-            /*  size */ chunk->gl.n_verts_simple * sizeof(*chunk->gl.verts_simple),
-            /*  data */ chunk->gl.verts_simple,
-            /* usage */ GL_DYNAMIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    gpu_heap_free(&simple_heap, chunk->gl.simple_heap_offset, chunk->gl.simple_heap_count);
+    chunk->gl.simple_heap_offset = gpu_heap_alloc(&simple_heap, chunk->gl.n_verts_simple);
+    chunk->gl.simple_heap_count = chunk->gl.n_verts_simple;
+    gpu_heap_upload(&simple_heap, chunk->gl.simple_heap_offset, chunk->gl.simple_heap_count, chunk->gl.verts_simple);
 }
 
-static void remesh_chunk_complex(world_chunk *chunk)
+/* flood fills every section through non-opaque blocks and records which faces
+ * each connected air pocket touches */
+static void compute_section_connectivity(world_chunk *chunk)
 {
-    if(!chunk->gl.needs_remesh_complex)
-        return;
+    static bool visited[16 * 16 * 16];
+    static uint16_t stack[16 * 16 * 16];
 
-    chunk->gl.needs_remesh_complex = false;
+    chunk->gl.opaque_sections = 0;
 
-    /* free old data */
-    mem_free(chunk->gl.verts_complex);
+    for(int section = 0; section < WORLD_CHUNK_SECTIONS; section++) {
+        uint64_t connectivity = 0;
+        int num_opaque = 0;
+
+        for(int i = 0; i < 16 * 16 * 16; i++) {
+            block_data b = chunk->data[IDX_FROM_COORDS(i >> 8, (section << 4) | (i & 15), (i >> 4) & 15)];
+            visited[i] = !block_is_transparent(b);
+            num_opaque += visited[i];
+        }
+
+        if(num_opaque == 16 * 16 * 16)
+            chunk->gl.opaque_sections |= 1 << section;
+
+        for(int start = 0; start < 16 * 16 * 16; start++) {
+            int sp = 0, faces = 0;
+
+            if(visited[start])
+                continue;
+
+            visited[start] = true;
+            stack[sp++] = start;
+
+            while(sp > 0) {
+                int i = stack[--sp];
+                int x = i >> 8, z = (i >> 4) & 15, y = i & 15;
+                int neighbours[6] = {
+                    [BLOCK_FACE_Y_NEG] = y > 0 ? i - 1 : -1,
+                    [BLOCK_FACE_Y_POS] = y < 15 ? i + 1 : -1,
+                    [BLOCK_FACE_Z_NEG] = z > 0 ? i - 16 : -1,
+                    [BLOCK_FACE_Z_POS] = z < 15 ? i + 16 : -1,
+                    [BLOCK_FACE_X_NEG] = x > 0 ? i - 256 : -1,
+                    [BLOCK_FACE_X_POS] = x < 15 ? i + 256 : -1
+                };
+
+                for(int face = 0; face < 6; face++) {
+                    if(neighbours[face] < 0) {
+                        faces |= 1 << face;
+                    } else if(!visited[neighbours[face]]) {
+                        visited[neighbours[face]] = true;
+                        stack[sp++] = neighbours[face];
+                    }
+                }
+            }
+
+            for(int a = 0; a < 6; a++) {
+                for(int b = 0; b < 6; b++) {
+                    if((faces & (1 << a)) && (faces & (1 << b)))
+                        connectivity |= 1ull << (a * 6 + b);
+                }
+            }
+        }
+
+        chunk->gl.section_connectivity[section] = connectivity;
+    }
+}
+
+static void build_chunk_mesh_complex(world_chunk *chunk)
+{
+    size_t bucket_sizes[MESHBUILDER_MAX_BUCKETS];
+
+    if(!templates.built)
+        build_templates();
+    fluid_corners_reset();
 
     meshbuilder_start(sizeof(*chunk->gl.verts_complex));
 
@@ -1317,240 +1823,695 @@ static void remesh_chunk_complex(world_chunk *chunk)
                 int x = x_off + (chunk->x << 4);
                 int z = z_off + (chunk->z << 4);
                 block_data block = world_get_block_fast(chunk, x, y, z);
-                block_properties props = block_get_properties(block.id);
+                block_render_type render_type = block_get_render_type(block.id);
 
-                if(props.render_type == RENDER_CUBE && block.id == BLOCK_GRASS && r_fancygrass.integer != 0)
-                    render_grass_side_overlay(x, y, z, block);
-
-                //if(props.render_type == RENDER_CUBE)
+                //if(render_type == RENDER_CUBE)
                 //    continue;
 
-                render_funcs[props.render_type](x, y, z, block);
+                meshbuilder_set_bucket(SECTION_BUCKET(block_get_render_pass(block), y >> 4));
+                mesh_far_section = !(chunk->gl.detail_sections & (1 << (y >> 4)));
+                if(mesh_far_section)
+                    render_far(x, y, z, block, render_type);
+                else
+                    render_funcs[render_type](x, y, z, block);
             }
         }
     }
+    mesh_far_section = false;
 
-    meshbuilder_finish((void **) &chunk->gl.verts_complex, &chunk->gl.n_verts_complex, NULL, NULL);
+    meshbuilder_finish((void **) &chunk->gl.verts_complex, &chunk->gl.n_verts_complex, NULL, NULL, bucket_sizes);
 
-    glBindBuffer(GL_ARRAY_BUFFER, chunk->gl.vbo_complex);
-    glBufferData(GL_ARRAY_BUFFER,
-            /*  size */ chunk->gl.n_verts_complex * sizeof(*chunk->gl.verts_complex),
-            /*  data */ chunk->gl.verts_complex,
-            /* usage */ GL_DYNAMIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    for(int pass = 0; pass < RENDER_PASS_COUNT; pass++) {
+        for(int section = 0; section < WORLD_CHUNK_SECTIONS; section++)
+            chunk->gl.pass_count[pass][section] = bucket_sizes[SECTION_BUCKET(pass, section)];
+    }
 }
 
-void remesh_chunk(world_chunk *chunk)
+static void remesh_chunk_complex(world_chunk *chunk)
 {
-    ubyte data[128][32][32]; // D H W
+    size_t first = 0;
+    uint64_t key = 0;
 
-    if(num_remeshed >= r_max_remeshes.integer)
+    if(!chunk->gl.needs_remesh_complex)
         return;
 
-    world_renderer_update_chunk_visibility(chunk);
+    chunk->gl.needs_remesh_complex = false;
+
+    /* free old data */
+    mem_free(chunk->gl.verts_complex);
+
+    chunk->gl.detail_sections = get_detail_sections(chunk);
+    if(r_mesh_cache.integer)
+        key = mesh_cache_key(chunk);
+
+    if(!r_mesh_cache.integer || !mesh_cache_load(chunk, key)) {
+        build_chunk_mesh_complex(chunk);
+        if(r_mesh_cache.integer)
+            mesh_cache_store(chunk, key);
+    }
+
+    for(int pass = 0; pass < RENDER_PASS_COUNT; pass++) {
+        for(int section = 0; section < WORLD_CHUNK_SECTIONS; section++) {
+            chunk->gl.pass_first[pass][section] = first;
+            first += chunk->gl.pass_count[pass][section];
+        }
+    }
+
+    compute_section_connectivity(chunk);
+
+    chunk->gl.meshed = true;
+    chunk->gl.mesh_neighbours = world_get_chunk_neighbours(chunk->x, chunk->z);
+    lod_renderer_update_column(chunk);
+
+    gpu_heap_free(&complex_heap, chunk->gl.heap_offset, chunk->gl.heap_count);
+    chunk->gl.heap_offset = gpu_heap_alloc(&complex_heap, chunk->gl.n_verts_complex);
+    chunk->gl.heap_count = chunk->gl.n_verts_complex;
+    gpu_heap_upload(&complex_heap, chunk->gl.heap_offset, chunk->gl.heap_count, chunk->gl.verts_complex);
+}
+
+void remesh_chunk(world_chunk *chunk)
+{
+    if(num_remeshed >= r_max_remeshes.integer)
+        return;
 
     if(chunk->gl.needs_remesh_complex || chunk->gl.needs_remesh_simple)
         num_remeshed++;
 
     remesh_chunk_simple(chunk);
     remesh_chunk_complex(chunk);
+    upload_chunk_light(chunk);
+    chunk->gl.needs_light_upload = false;
+}
+
+static float chunk_dist_to_camera(const world_chunk *chunk)
+{
+    float dx = (float) (chunk->x * WORLD_CHUNK_SIZE + WORLD_CHUNK_SIZE / 2) - cam_pos.x;
+    float dz = (float) (chunk->z * WORLD_CHUNK_SIZE + WORLD_CHUNK_SIZE / 2) - cam_pos.z;
+    return dx * dx + dz * dz;
+}
+
+/* chunks beyond r_lod_distance are left to the lod renderer, as are chunks that have no mesh yet */
+static void update_chunk_detail(world_chunk *chunk, float dist)
+{
+    float lod_dist = r_lod_distance.value * WORLD_CHUNK_SIZE;
+    chunk->gl.detailed = !r_lod.integer || (chunk->gl.meshed && dist <= lod_dist * lod_dist);
 
-    for(int w = 0; w < 18; w++) {
-        for(int h = 0; h < 18; h++) {
-            for(int d = 0; d < 128; d++) {
-                block_data b = world_get_block((chunk->x << 4) + w - 1, d, (chunk->z << 4) + h - 1);
-                data[d][h][w] = max(b.blocklight, b.skylight);
+    if(chunk->gl.meshed && get_detail_sections(chunk) != chunk->gl.detail_sections)
+        chunk->gl.needs_remesh_complex = true;
+}
+
+static int draw_list_entry_compare(const void *a, const void *b)
+{
+    const struct draw_list_entry *ea = a, *eb = b;
+    return (ea->dist > eb->dist) - (ea->dist < eb->dist);
+}
+
+static void rebuild_section_bounds(void)
+{
+    /* padded to the simd width, the padding repeats the last box */
+    size_t count = (draw_list.count * WORLD_CHUNK_SECTIONS + 7) & ~(size_t) 7;
+
+    if(section_bounds.capacity < count) {
+        section_bounds.capacity = count * 2;
+        section_bounds.x = realloc(section_bounds.x, section_bounds.capacity * sizeof(float));
+        section_bounds.y = realloc(section_bounds.y, section_bounds.capacity * sizeof(float));
+        section_bounds.z = realloc(section_bounds.z, section_bounds.capacity * sizeof(float));
+        section_bounds.inside = realloc(section_bounds.inside, section_bounds.capacity);
+    }
+
+    section_bounds.count = count;
+
+    for(size_t i = 0; i < count; i++) {
+        size_t c = min(i / WORLD_CHUNK_SECTIONS, draw_list.count - 1);
+        world_chunk *chunk = draw_list.entries[c].chunk;
+
+        chunk->gl.bounds_index = c * WORLD_CHUNK_SECTIONS;
+        section_bounds.x[i] = (float) (chunk->x << 4);
+        section_bounds.y[i] = (float) ((i % WORLD_CHUNK_SECTIONS) << 4);
+        section_bounds.z[i] = (float) (chunk->z << 4);
+    }
+}
+
+/* tests every box of the bounds table against the 6 frustum planes. for every plane only the corner
+ * furthest along its normal matters, and since the normal is the same for all boxes that corner
+ * is picked once per plane instead of once per box */
+static void update_frustum_sections(void)
+{
+    const struct plane *planes[6] = {&frustum.left, &frustum.right, &frustum.top,
+                                     &frustum.bottom, &frustum.near, &frustum.far};
+    const float size = WORLD_CHUNK_SIZE;
+
+#if defined(__AVX__)
+    for(size_t i = 0; i < section_bounds.count; i += 8) {
+        __m256 x = _mm256_loadu_ps(&section_bounds.x[i]);
+        __m256 y = _mm256_loadu_ps(&section_bounds.y[i]);
+        __m256 z = _mm256_loadu_ps(&section_bounds.z[i]);
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        int mask;
+
+        for(int p = 0; p < 6; p++) {
+            const struct plane *pl = planes[p];
+            __m256 px = pl->normal.x > 0 ? _mm256_add_ps(x, _mm256_set1_ps(size)) : x;
+            __m256 py = pl->normal.y > 0 ? _mm256_add_ps(y, _mm256_set1_ps(size)) : y;
+            __m256 pz = pl->normal.z > 0 ? _mm256_add_ps(z, _mm256_set1_ps(size)) : z;
+            __m256 dist = _mm256_mul_ps(px, _mm256_set1_ps(pl->normal.x));
+            dist = _mm256_add_ps(dist, _mm256_mul_ps(py, _mm256_set1_ps(pl->normal.y)));
+            dist = _mm256_add_ps(dist, _mm256_mul_ps(pz, _mm256_set1_ps(pl->normal.z)));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(dist, _mm256_set1_ps(pl->dist), _CMP_GE_OQ));
+        }
+
+        mask = _mm256_movemask_ps(inside);
+        for(int k = 0; k < 8; k++)
+            section_bounds.inside[i + k] = (mask >> k) & 1;
+    }
+#elif defined(__SSE__)
+    for(size_t i = 0; i < section_bounds.count; i += 4) {
+        __m128 x = _mm_loadu_ps(&section_bounds.x[i]);
+        __m128 y = _mm_loadu_ps(&section_bounds.y[i]);
+        __m128 z = _mm_loadu_ps(&section_bounds.z[i]);
+        __m128 inside = _mm_cmpeq_ps(x, x);
+        int mask;
+
+        for(int p = 0; p < 6; p++) {
+            const struct plane *pl = planes[p];
+            __m128 px = pl->normal.x > 0 ? _mm_add_ps(x, _mm_set1_ps(size)) : x;
+            __m128 py = pl->normal.y > 0 ? _mm_add_ps(y, _mm_set1_ps(size)) : y;
+            __m128 pz = pl->normal.z > 0 ? _mm_add_ps(z, _mm_set1_ps(size)) : z;
+            __m128 dist = _mm_mul_ps(px, _mm_set1_ps(pl->normal.x));
+            dist = _mm_add_ps(dist, _mm_mul_ps(py, _mm_set1_ps(pl->normal.y)));
+            dist = _mm_add_ps(dist, _mm_mul_ps(pz, _mm_set1_ps(pl->normal.z)));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(dist, _mm_set1_ps(pl->dist)));
+        }
+
+        mask = _mm_movemask_ps(inside);
+        for(int k = 0; k < 4; k++)
+            section_bounds.inside[i + k] = (mask >> k) & 1;
+    }
+#else
+    for(size_t i = 0; i < section_bounds.count; i++) {
+        bool inside = true;
+
+        for(int p = 0; p < 6 && inside; p++) {
+            const struct plane *pl = planes[p];
+            vec3_t corner = vec3(section_bounds.x[i] + (pl->normal.x > 0 ? size : 0),
+                                 section_bounds.y[i] + (pl->normal.y > 0 ? size : 0),
+                                 section_bounds.z[i] + (pl->normal.z > 0 ? size : 0));
+            inside = get_dist_to_plane(pl, corner) >= 0;
+        }
+
+        section_bounds.inside[i] = inside;
+    }
+#endif
+
+    for(size_t i = 0; i < draw_list.count; i++) {
+        world_chunk *chunk = draw_list.entries[i].chunk;
+        ubyte *inside = &section_bounds.inside[chunk->gl.bounds_index];
+
+        chunk->gl.frustum_sections = 0;
+        for(int section = 0; section < WORLD_CHUNK_SECTIONS; section++)
+            chunk->gl.frustum_sections |= inside[section] << section;
+    }
+}
+
+static void update_draw_list(void)
+{
+    if(draw_list.map_version != world_chunk_map_version) {
+        /* chunks were added or removed, their pointers may have changed as well */
+        size_t i = 0;
+        void *it;
+
+        if(draw_list.capacity < hashmap_count(world_chunk_map)) {
+            draw_list.capacity = hashmap_count(world_chunk_map) * 2;
+            draw_list.entries = realloc(draw_list.entries, draw_list.capacity * sizeof(*draw_list.entries));
+        }
+
+        draw_list.count = 0;
+        while(hashmap_iter(world_chunk_map, &i, &it)) {
+            world_chunk *chunk = it;
+            draw_list.entries[draw_list.count].chunk = chunk;
+            draw_list.entries[draw_list.count].dist = chunk_dist_to_camera(chunk);
+            update_chunk_detail(chunk, draw_list.entries[draw_list.count].dist);
+            draw_list.count++;
+        }
+
+        rebuild_section_bounds();
+
+        qsort(draw_list.entries, draw_list.count, sizeof(*draw_list.entries), draw_list_entry_compare);
+        draw_list.map_version = world_chunk_map_version;
+        return;
+    }
+
+    /* the camera moves only a little between frames, so the list is almost sorted
+     * already and insertion sort gets through it in close to linear time */
+    for(size_t i = 0; i < draw_list.count; i++) {
+        draw_list.entries[i].dist = chunk_dist_to_camera(draw_list.entries[i].chunk);
+        update_chunk_detail(draw_list.entries[i].chunk, draw_list.entries[i].dist);
+    }
+
+    for(size_t i = 1; i < draw_list.count; i++) {
+        struct draw_list_entry e = draw_list.entries[i];
+        size_t j = i;
+        while(j > 0 && draw_list.entries[j - 1].dist > e.dist) {
+            draw_list.entries[j] = draw_list.entries[j - 1];
+            j--;
+        }
+        draw_list.entries[j] = e;
+    }
+}
+
+static void defrag_complex_heap(void)
+{
+    int moved = 0;
+
+    if(gpu_heap_fragmentation(&complex_heap) < DEFRAG_MIN_FRAGMENTATION)
+        return;
+
+    for(size_t i = 0; i < draw_list.count && moved < DEFRAG_MOVES_PER_FRAME; i++) {
+        world_chunk *chunk = draw_list.entries[i].chunk;
+        size_t offset = gpu_heap_relocate(&complex_heap, chunk->gl.heap_offset, chunk->gl.heap_count);
+
+        if(offset != chunk->gl.heap_offset) {
+            chunk->gl.heap_offset = offset;
+            moved++;
+        }
+    }
+}
+
+bool world_renderer_bbox_on_frustum(bbox_t box)
+{
+    const struct plane *planes[6] = {&frustum.left, &frustum.right, &frustum.top,
+                                     &frustum.bottom, &frustum.near, &frustum.far};
+
+    for(int p = 0; p < 6; p++) {
+        const struct plane *pl = planes[p];
+        vec3_t corner = vec3(pl->normal.x > 0 ? box.maxs.x : box.mins.x,
+                             pl->normal.y > 0 ? box.maxs.y : box.mins.y,
+                             pl->normal.z > 0 ? box.maxs.z : box.mins.z);
+        if(get_dist_to_plane(pl, corner) < 0)
+            return false;
+    }
+
+    return true;
+}
+
+static bool is_section_on_frustum(const world_chunk *chunk, int section)
+{
+    return chunk->gl.frustum_sections & (1 << section);
+}
+
+/* breadth first search over sections starting at the camera. a section is only entered if it is
+ * on the frustum, if its entry face is connected to the exit face of the previous section and if
+ * the search never turns back towards the camera. sections hidden behind solid terrain (caves)
+ * never get reached */
+static void update_section_visibility(void)
+{
+    static struct section_node {
+        world_chunk *chunk;
+        int section;
+        ubyte entered_from; // face of this section, 6 for the camera section
+        ubyte directions;   // faces (as directions) the search went through to get here
+    } *queue;
+    static size_t queue_capacity;
+    static const int dx[6] = {[BLOCK_FACE_X_NEG] = -1, [BLOCK_FACE_X_POS] = 1};
+    static const int dy[6] = {[BLOCK_FACE_Y_NEG] = -1, [BLOCK_FACE_Y_POS] = 1};
+    static const int dz[6] = {[BLOCK_FACE_Z_NEG] = -1, [BLOCK_FACE_Z_POS] = 1};
+
+    int cam_cx = (int) floorf(cam_pos.x / WORLD_CHUNK_SIZE);
+    int cam_cz = (int) floorf(cam_pos.z / WORLD_CHUNK_SIZE);
+    int cam_section = bound(0, (int) floorf(cam_pos.y / WORLD_CHUNK_SIZE), WORLD_CHUNK_SECTIONS - 1);
+    world_chunk *cam_chunk = world_get_chunk(cam_cx, cam_cz);
+    size_t head = 0, tail = 0;
+
+    update_frustum_sections();
+
+    for(size_t i = 0; i < draw_list.count; i++)
+        draw_list.entries[i].chunk->gl.visible_sections = 0;
+
+    if(!r_cave_culling.integer || cam_chunk == NULL) {
+        /* nothing to start from, fall back to the frustum */
+        for(size_t i = 0; i < draw_list.count; i++) {
+            world_chunk *chunk = draw_list.entries[i].chunk;
+            for(int section = 0; section < WORLD_CHUNK_SECTIONS; section++) {
+                if(chunk->gl.detailed && is_section_on_frustum(chunk, section))
+                    chunk->gl.visible_sections |= 1 << section;
             }
+            chunk->gl.visible = chunk->gl.visible_sections != 0;
         }
+        return;
     }
 
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_3D, chunk->gl.light_tex);
-    glTexImage3D(GL_TEXTURE_3D, 0, GL_R8, 32, 32, 128, 0, GL_RED, GL_UNSIGNED_BYTE, data);
-    glBindTexture(GL_TEXTURE_3D, 0);
-    glActiveTexture(GL_TEXTURE0);
+    if(queue_capacity < draw_list.count * WORLD_CHUNK_SECTIONS) {
+        queue_capacity = draw_list.count * WORLD_CHUNK_SECTIONS;
+        queue = realloc(queue, queue_capacity * sizeof(*queue));
+    }
+
+    cam_chunk->gl.visible_sections |= 1 << cam_section;
+    queue[tail++] = (struct section_node) {cam_chunk, cam_section, 6, 0};
+
+    while(head < tail) {
+        struct section_node node = queue[head++];
+        uint64_t connectivity = node.chunk->gl.section_connectivity[node.section];
+
+        for(int dir = 0; dir < 6; dir++) {
+            int opposite = dir ^ 1;
+            int section = node.section + dy[dir];
+            world_chunk *next = node.chunk;
+
+            /* never go back towards the camera */
+            if(node.directions & (1 << opposite))
+                continue;
+
+            if(node.entered_from != 6 && !(connectivity & (1ull << (node.entered_from * 6 + dir))))
+                continue;
+
+            if(section < 0 || section >= WORLD_CHUNK_SECTIONS)
+                continue;
+
+            if(dx[dir] != 0 || dz[dir] != 0) {
+                next = world_get_chunk(node.chunk->x + dx[dir], node.chunk->z + dz[dir]);
+                if(next == NULL)
+                    continue;
+            }
+
+            if(next->gl.visible_sections & (1 << section) || !is_section_on_frustum(next, section))
+                continue;
+
+            next->gl.visible_sections |= 1 << section;
+            queue[tail++] = (struct section_node) {next, section, opposite, node.directions | (1 << dir)};
+        }
+    }
+
+    /* far chunks still take part in the search so that detailed ones behind them are found,
+     * but are drawn by the lod renderer */
+    for(size_t i = 0; i < draw_list.count; i++) {
+        world_chunk *chunk = draw_list.entries[i].chunk;
+        if(!chunk->gl.detailed)
+            chunk->gl.visible_sections = 0;
+        chunk->gl.visible = chunk->gl.visible_sections != 0;
+    }
 }
 
-void world_renderer_update_chunk_visibility(world_chunk *chunk)
+/* draws runs of fully opaque sections of the nearest chunks into the software depth buffer,
+ * then drops the sections that end up completely behind them */
+static void update_occlusion(void)
 {
-    static const float cube_diagonal_half = SQRT_3 * WORLD_CHUNK_SIZE / 2.0f;
+    int num_occluders = 0;
 
-    int x_center = chunk->x * WORLD_CHUNK_SIZE + WORLD_CHUNK_SIZE / 2;
-    int z_center = chunk->z * WORLD_CHUNK_SIZE + WORLD_CHUNK_SIZE / 2;
+    occlusion_begin(view_mat, proj_mat, cam_pos);
 
-    for(int i = 0; i < 8; i++) {
-        int y_center = i * WORLD_CHUNK_SIZE + WORLD_CHUNK_SIZE / 2;
-        chunk->gl.visible = is_visible_on_frustum(vec3(x_center, y_center, z_center), cube_diagonal_half);
-        if(chunk->gl.visible) {
-            break;
+    for(size_t i = 0; i < draw_list.count && num_occluders < MAX_OCCLUDERS; i++) {
+        world_chunk *chunk = draw_list.entries[i].chunk;
+        int section = 0;
+
+        while(section < WORLD_CHUNK_SECTIONS) {
+            int end = section;
+
+            while(end < WORLD_CHUNK_SECTIONS && chunk->gl.opaque_sections & (1 << end))
+                end++;
+
+            if(end > section) {
+                occlusion_add_occluder(vec3(chunk->x << 4, section << 4, chunk->z << 4),
+                                       vec3((chunk->x << 4) + 16, end << 4, (chunk->z << 4) + 16));
+                num_occluders++;
+            }
+
+            section = end + 1;
+        }
+    }
+
+    for(size_t i = 0; i < draw_list.count; i++) {
+        world_chunk *chunk = draw_list.entries[i].chunk;
+
+        for(int section = 0; section < WORLD_CHUNK_SECTIONS; section++) {
+            vec3_t mins = vec3(chunk->x << 4, section << 4, chunk->z << 4);
+
+            if(!(chunk->gl.visible_sections & (1 << section)))
+                continue;
+
+            if(!occlusion_test_box(mins, vec3_add(mins, vec3_1(16))))
+                chunk->gl.visible_sections &= ~(1 << section);
+        }
+
+        chunk->gl.visible = chunk->gl.visible_sections != 0;
+    }
+}
+
+/* builds the indirect draw commands of all passes and uploads them in one go.
+ * the sections of a pass are contiguous, so neighbouring visible sections share one command */
+static void build_draw_commands(void)
+{
+    size_t needed = draw_list.count * RENDER_PASS_COUNT * WORLD_CHUNK_SECTIONS;
+
+    if(indirect.capacity < needed) {
+        indirect.capacity = needed * 2;
+        indirect.cmds = realloc(indirect.cmds, indirect.capacity * sizeof(*indirect.cmds));
+    }
+
+    indirect.count = 0;
+    for(int pass = 0; pass < RENDER_PASS_COUNT; pass++) {
+        indirect.pass_start[pass] = indirect.count;
+
+        for(size_t i = 0; i < draw_list.count; i++) {
+            /* blending needs back to front, everything else goes front to back */
+            size_t idx = pass == RENDER_PASS_TRANSLUCENT ? draw_list.count - 1 - i : i;
+            world_chunk *chunk = draw_list.entries[idx].chunk;
+            struct draw_cmd *cmd = NULL;
+
+            if(chunk->gl.visible_sections == 0 || chunk->gl.slot < 0)
+                continue;
+
+            for(int section = 0; section < WORLD_CHUNK_SECTIONS; section++) {
+                size_t count = chunk->gl.pass_count[pass][section];
+
+                if(!(chunk->gl.visible_sections & (1 << section))) {
+                    cmd = NULL;
+                    continue;
+                }
+
+                if(count == 0)
+                    continue;
+
+                if(cmd != NULL && cmd->first + cmd->count == chunk->gl.heap_offset + chunk->gl.pass_first[pass][section]) {
+                    cmd->count += count;
+                    continue;
+                }
+
+                cmd = &indirect.cmds[indirect.count++];
+                cmd->count = count;
+                cmd->instance_count = 1;
+                cmd->first = chunk->gl.heap_offset + chunk->gl.pass_first[pass][section];
+                cmd->base_instance = chunk->gl.slot;
+            }
         }
+
+        indirect.pass_count[pass] = indirect.count - indirect.pass_start[pass];
     }
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect.buffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, indirect.count * sizeof(*indirect.cmds), indirect.cmds, GL_STREAM_DRAW);
+}
+
+static void render_complex_pass(block_render_pass pass)
+{
+    if(indirect.pass_count[pass] == 0)
+        return;
+
+    glUseProgram(gl.shader_blocks_complex[pass]);
+
+    glUniformMatrix4fv(loc_complex[pass].view, 1, GL_FALSE, (const GLfloat *) view_mat);
+    glUniformMatrix4fv(loc_complex[pass].proj, 1, GL_FALSE, (const GLfloat *) proj_mat);
+    glUniform1f(loc_complex[pass].nightlightmod, world_calculate_sky_light_modifier());
+    glUniform1i(loc_complex[pass].terraintex, 0);
+    glUniform1i(loc_complex[pass].lighttex, 1);
+
+    /* fancy grass is the overlay drawn over the grass sides in the fragment shader, so it needs no
+     * geometry and toggling it needs no remesh */
+    glUniform1i(loc_complex[pass].grassside,
+                r_fancygrass.integer ? block_get_texture_index(BLOCK_GRASS, BLOCK_FACE_X_POS, 0, 0, 0, 0) : -1);
+    glUniform1i(loc_complex[pass].grassoverlay, block_get_texture_index(BLOCK_GRASS_OVERLAY, BLOCK_FACE_X_POS, 0, 0, 0, 0));
+    glUniform1f(loc_complex[pass].detaildist, max(r_detail_distance.value, 0.0f));
+
+    glMultiDrawArraysIndirect(GL_TRIANGLES, (const void *) (indirect.pass_start[pass] * sizeof(struct draw_cmd)),
+                              indirect.pass_count[pass], 0);
 }
 
 void world_render(void)
 {
-    size_t i;
-    void *it;
 
     if(cl.state < cl_connected)
         return;
 
-    if(cl.game.rotated || cl.game.moved)
-        recalculate_projection_matrix();
-    else
-        update_view_matrix_and_frustum();
+    update_view_matrix_and_frustum();
+
+    update_draw_list();
 
     glLineWidth(1.0f);
     if(!strcasecmp(gl_polygon_mode.string, "GL_LINE")) {
         glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
     } else if(!strcasecmp(gl_polygon_mode.string, "GL_POINT")) {
         glPolygonMode(GL_FRONT_AND_BACK, GL_POINT);
-        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
     } else {
         glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-        glBindTexture(GL_TEXTURE_2D, gl_world_texture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, gl_world_texture);
     }
 
     glPointSize(5.0f);
 
+    num_remeshed = 0;
+    num_light_uploads = 0;
+
+    /* nearest chunks get remeshed first, chunks whose light changed only get their light uploaded */
+    for(size_t i = 0; i < draw_list.count; i++) {
+        world_chunk *chunk = draw_list.entries[i].chunk;
+        if(chunk->gl.needs_remesh_simple || chunk->gl.needs_remesh_complex) {
+            remesh_chunk(chunk);
+        } else if(chunk->gl.needs_light_upload && num_light_uploads < LIGHT_UPLOADS_PER_FRAME) {
+            upload_chunk_light(chunk);
+            chunk->gl.needs_light_upload = false;
+            num_light_uploads++;
+        }
+    }
+
+    if(num_remeshed == 0)
+        defrag_complex_heap();
+
+    update_section_visibility();
+    if(r_occlusion_culling.integer)
+        update_occlusion();
+
     glUseProgram(gl.shader_blocks_simple);
     glUniformMatrix4fv(loc_view, 1, GL_FALSE, (const GLfloat *) view_mat);
     glUniformMatrix4fv(loc_proj, 1, GL_FALSE, (const GLfloat *) proj_mat);
     glUniform1f(loc_nightlightmod, world_calculate_sky_light_modifier());
 
     glBindVertexArray(gl_world_vao_simple);
+    glBindVertexBuffer(0, simple_heap.buffer, 0, sizeof(struct vert_simple));
 
-    num_remeshed = 0;
-
-    i = 0;
-    while(hashmap_iter(world_chunk_map, &i, &it)) {
-        world_chunk *chunk = (world_chunk *) it;
+    /* go from front to back so that the gpu can discard pixels of meshes behind the ones already drawn */
+    for(size_t i = 0; i < draw_list.count; i++) {
+        world_chunk *chunk = draw_list.entries[i].chunk;
         vec3_t chunk_pos = vec3(chunk->x << 4, 0, chunk->z << 4);
 
-        if(chunk->gl.needs_remesh_simple)
-            remesh_chunk(chunk);
-
-        /* go from top to bottom so that the gpu can discard pixels of cave meshes which won't be seen */
-
         if(!chunk->gl.visible)
             continue;
 
         if(chunk->gl.n_verts_simple > 0) {
             glUniform3fv(loc_chunkpos, 1, chunk_pos.array);
-            glBindVertexBuffer(0, chunk->gl.vbo_simple, 0, sizeof(*chunk->gl.verts_simple));
-            glDrawArrays(GL_TRIANGLES, 0, chunk->gl.n_verts_simple);
+            glDrawArrays(GL_TRIANGLES, chunk->gl.simple_heap_offset, chunk->gl.n_verts_simple);
         }
     }
 
-    glUseProgram(gl.shader_blocks_complex);
-
-    glUniformMatrix4fv(loc_view2, 1, GL_FALSE, (const GLfloat *) view_mat);
-    glUniformMatrix4fv(loc_proj2, 1, GL_FALSE, (const GLfloat *) proj_mat);
-    glUniform1f(loc_nightlightmod2, world_calculate_sky_light_modifier());
+    /* far terrain goes in before the complex meshes, the two never overlap */
+    lod_renderer_render(cam_pos);
 
     glActiveTexture(GL_TEXTURE0);
     if(!strcasecmp(gl_polygon_mode.string, "GL_LINE")) {
         glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
     } else if(!strcasecmp(gl_polygon_mode.string, "GL_POINT")) {
         glPolygonMode(GL_FRONT_AND_BACK, GL_POINT);
-        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
     } else {
         glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-        glBindTexture(GL_TEXTURE_2D, gl_world_texture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, gl_world_texture);
     }
 
-    glUniform1i(loc_terraintex, 0);
-    glUniform1i(loc_lighttex, 1);
-
     glBindVertexArray(gl_world_vao_complex);
+    glBindVertexBuffer(0, complex_heap.buffer, 0, sizeof(struct vert_complex));
+    glBindVertexBuffer(1, slots.draw_id_vbo, 0, sizeof(GLuint));
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, slots.ssbo);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_3D, slots.light_atlas);
+    glActiveTexture(GL_TEXTURE0);
 
-    i = 0;
-    while(hashmap_iter(world_chunk_map, &i, &it)) {
-        world_chunk *chunk = (world_chunk *) it;
-        vec3_t chunk_pos = vec3(chunk->x << 4, 0, chunk->z << 4);
-
-        if(chunk->gl.needs_remesh_complex)
-            remesh_chunk(chunk);
-
-        /* go from top to bottom so that the gpu can discard pixels of cave meshes which won't be seen */
-
-        if(!chunk->gl.visible)
-            continue;
-
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_3D, chunk->gl.light_tex);
+    build_draw_commands();
 
-        if(chunk->gl.n_verts_complex > 0) {
-            glUniform3fv(loc_chunkpos2, 1, chunk_pos.array);
-            glBindVertexBuffer(0, chunk->gl.vbo_complex, 0, sizeof(*chunk->gl.verts_complex));
-            glDrawArrays(GL_TRIANGLES, 0, chunk->gl.n_verts_complex);
-        }
-    }
+    /* opaque geometry has no blending and no discard, so early depth testing can reject most of what
+     * comes after it. cutout geometry is alpha tested, translucent geometry is blended on top of
+     * everything else from back to front without writing depth */
+    glDisable(GL_BLEND);
+    render_complex_pass(RENDER_PASS_OPAQUE);
+    /* grass overlays lie exactly on top of opaque faces */
+    glDepthFunc(GL_LEQUAL);
+    render_complex_pass(RENDER_PASS_CUTOUT);
+    glEnable(GL_BLEND);
+    glDepthMask(GL_FALSE);
+    render_complex_pass(RENDER_PASS_TRANSLUCENT);
 
-    glBindTexture(GL_TEXTURE_3D, 0);
-    glActiveTexture(GL_TEXTURE0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
 
     /* draw block selection box */
     if(!cl.game.look_trace.reached_end) {
-        vec3_t cp = vec3_1(0);
-        glUniform3fv(loc_chunkpos2, 1, cp.array);
+        glUseProgram(gl.shader_blocks_complex[RENDER_PASS_TRANSLUCENT]);
         glLineWidth(2.0f);
         glBindVertexBuffer(0, gl_block_selection_vbo, 0, sizeof(struct vert_complex));
-        glDrawArrays(GL_LINE_STRIP, 0, 16);
+        glDrawArraysInstancedBaseInstance(GL_LINE_STRIP, 0, 16, 1, SELECTION_BOX_SLOT);
     }
 
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_3D, 0);
+    glActiveTexture(GL_TEXTURE0);
+
+    glDepthMask(GL_TRUE);
+    glDepthFunc(GL_LESS);
+
+    gpu_heap_end_frame();
+
     /* done */
     glBindVertexArray(0);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
 }
 
-void world_gen_light_texture(world_chunk *chunk)
+void world_init_chunk_glbufs(world_chunk *chunk)
 {
-    GLuint tex;
-    ubyte data[128][32][32]; // D H W
-
-    for(int w = 0; w < 17; w++) {
-        for(int h = 0; h < 17; h++) {
-            for(int d = 0; d < 128; d++) {
-                block_data b = world_get_block((chunk->x << 4) + w, d, (chunk->z << 4) + h);
-                data[d][h][w] = (b.blocklight);
-            }
-        }
-    }
-
-    glGenTextures(1, &tex);
-    glBindTexture(GL_TEXTURE_3D, tex);
-
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-
-    glTexImage3D(GL_TEXTURE_3D, 0, GL_R8, 32, 32, 128, 0, GL_RED, GL_UNSIGNED_BYTE, data);
-
-    glBindTexture(GL_TEXTURE_3D, 0);
+    memset(&chunk->gl, 0, sizeof(chunk->gl));
+    chunk->gl.simple_heap_offset = GPU_HEAP_INVALID;
+    for(int section = 0; section < WORLD_CHUNK_SECTIONS; section++)
+        chunk->gl.section_connectivity[section] = ALL_FACES_CONNECTED;
+    chunk->gl.heap_offset = GPU_HEAP_INVALID;
+    chunk->gl.slot = slot_alloc();
+    if(chunk->gl.slot >= 0)
+        slot_set_chunk(chunk->gl.slot, chunk);
+    upload_chunk_light(chunk);
+}
 
-    chunk->gl.light_tex = tex;
+void world_release_chunk_glbufs(world_chunk *chunk)
+{
+    gpu_heap_free(&simple_heap, chunk->gl.simple_heap_offset, chunk->gl.simple_heap_count);
+    gpu_heap_free(&complex_heap, chunk->gl.heap_offset, chunk->gl.heap_count);
+    slot_free(chunk->gl.slot);
+    chunk->gl.simple_heap_offset = chunk->gl.heap_offset = GPU_HEAP_INVALID;
+    chunk->gl.simple_heap_count = chunk->gl.heap_count = 0;
+    chunk->gl.slot = -1;
+    chunk->gl.visible = chunk->gl.detailed = false;
 }
 
-void world_init_chunk_glbufs(world_chunk *chunk)
+void world_restore_chunk_glbufs(world_chunk *chunk, bool reuse_mesh)
 {
-    memset(&chunk->gl, 0, sizeof(chunk->gl));
-    glGenBuffers(1, &chunk->gl.vbo_complex);
-    glGenBuffers(1, &chunk->gl.vbo_simple);
-    world_gen_light_texture(chunk);
+    chunk->gl.slot = slot_alloc();
+    if(chunk->gl.slot >= 0)
+        slot_set_chunk(chunk->gl.slot, chunk);
+    upload_chunk_light(chunk);
+
+    if(!reuse_mesh || !chunk->gl.meshed) {
+        chunk->gl.needs_remesh_simple = true;
+        chunk->gl.needs_remesh_complex = true;
+        return;
+    }
+
+    chunk->gl.heap_offset = gpu_heap_alloc(&complex_heap, chunk->gl.n_verts_complex);
+    chunk->gl.heap_count = chunk->gl.n_verts_complex;
+    gpu_heap_upload(&complex_heap, chunk->gl.heap_offset, chunk->gl.heap_count, chunk->gl.verts_complex);
 }
 
 void world_free_chunk_glbufs(world_chunk *chunk)
 {
     mem_free(chunk->gl.verts_simple);
     mem_free(chunk->gl.verts_complex);
-    glDeleteBuffers(1, &chunk->gl.vbo_simple);
-    glDeleteBuffers(1, &chunk->gl.vbo_complex);
-    glDeleteTextures(1, &chunk->gl.light_tex);
+    gpu_heap_free(&simple_heap, chunk->gl.simple_heap_offset, chunk->gl.simple_heap_count);
+    gpu_heap_free(&complex_heap, chunk->gl.heap_offset, chunk->gl.heap_count);
+    slot_free(chunk->gl.slot);
     memset(&chunk->gl, 0, sizeof(chunk->gl));
 }